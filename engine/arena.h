@@ -0,0 +1,152 @@
+#ifndef SYNTHY_ARENA_H
+#define SYNTHY_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <string.h>
+
+#include "config.h"
+
+// monotonic allocator owning all engine objects, everything is allocated at startup or patch load
+// and released together when the arena goes away
+class Arena
+{
+public:
+    Arena(size_t capacity)
+    {
+        size = (capacity + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+        memory = (char*)std::aligned_alloc(PAGE_SIZE, size);
+        // without memory every allocation fails
+        if (!memory) {
+            size = 0;
+        }
+        else {
+            // touch every page now, so the audio thread never takes a page fault on it
+            memset(memory, 0, size);
+        }
+        used = 0;
+        destructors = nullptr;
+    }
+    
+    ~Arena()
+    {
+        for (Destructor *d = destructors; d; d = d->next) {
+            d->destroy(d->object, d->count);
+        }
+        std::free(memory);
+    }
+    
+    Arena(const Arena&) = delete;
+    Arena &operator=(const Arena&) = delete;
+    
+    // false when the memory could not be allocated
+    bool ok() const
+    {
+        return memory != nullptr;
+    }
+    
+    // returns nullptr when the arena is exhausted
+    void *allocate(size_t bytes, size_t alignment = alignof(std::max_align_t))
+    {
+        size_t start = (used + alignment - 1) / alignment * alignment;
+        if (start + bytes > size) {
+            return nullptr;
+        }
+        used = start + bytes;
+        return memory + start;
+    }
+    
+    template <typename T>
+    T *allocateArray(size_t count, size_t alignment = alignof(T))
+    {
+        Destructor *d = nullptr;
+        void *ptr = allocateWithDestructor<T>(sizeof(T) * count, std::max(alignment, alignof(T)), d);
+        if (!ptr) {
+            return nullptr;
+        }
+        T *array = (T*)ptr;
+        for (size_t i = 0; i < count; ++i) {
+            new (array + i) T();
+        }
+        registerDestructor<T>(d, array, count);
+        return array;
+    }
+    
+    template <typename T, typename... Args>
+    T *create(Args&&... args)
+    {
+        Destructor *d = nullptr;
+        void *ptr = allocateWithDestructor<T>(sizeof(T), alignof(T), d);
+        if (!ptr) {
+            return nullptr;
+        }
+        T *object = new (ptr) T(std::forward<Args>(args)...);
+        registerDestructor<T>(d, object, 1);
+        return object;
+    }
+    
+    size_t getUsed() const
+    {
+        return used;
+    }
+    
+private:
+    struct Destructor
+    {
+        void *object;
+        size_t count;
+        void (*destroy)(void *object, size_t count);
+        Destructor *next;
+    };
+    
+    template <typename T>
+    static void destroyArray(void *object, size_t count)
+    {
+        for (size_t i = count; i > 0; --i) {
+            ((T*)object)[i - 1].~T();
+        }
+    }
+    
+    // reserves the destructor record together with the object, so a full arena never leaks a destructor
+    template <typename T>
+    void *allocateWithDestructor(size_t bytes, size_t alignment, Destructor *&d)
+    {
+        size_t mark = used;
+        if (!std::is_trivially_destructible<T>::value) {
+            d = (Destructor*)allocate(sizeof(Destructor), alignof(Destructor));
+            if (!d) {
+                return nullptr;
+            }
+        }
+        void *ptr = allocate(bytes, alignment);
+        if (!ptr) {
+            used = mark;
+        }
+        return ptr;
+    }
+    
+    template <typename T>
+    void registerDestructor(Destructor *d, T *object, size_t count)
+    {
+        if (!d) {
+            return;
+        }
+        d->object = object;
+        d->count = count;
+        d->destroy = &destroyArray<T>;
+        d->next = destructors;
+        destructors = d;
+    }
+    
+    char *memory;
+    size_t size;
+    size_t used;
+    Destructor *destructors; // newest first, so objects die in reverse order of creation
+};
+
+#endif
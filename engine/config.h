@@ -0,0 +1,17 @@
+#ifndef SYNTHY_CONFIG_H
+#define SYNTHY_CONFIG_H
+
+#include <math.h>
+
+// Hertz to Angular
+#define H2W(hertz) (hertz)*2*(float)M_PI
+// "Safe" pointer delete
+#define DELETE_PTR(x) delete (x); (x) = nullptr
+
+const int AMPLITUDE = 20000;
+const int SAMPLE_RATE = 44100;
+const int CACHE_LINE = 64;
+const int PAGE_SIZE = 4096;
+const int MAX_NOTES = 256;
+
+#endif
@@ -0,0 +1,285 @@
+#include "engine.h"
+
+#include <algorithm>
+
+#include "oversampler.h"
+#include "realtime.h"
+#include "tables.h"
+
+// float full scale matches the 16 bit output, where one note peaks at AMPLITUDE/4
+const float OUTPUT_GAIN = AMPLITUDE/4 / 32768.0f;
+
+const int MASTER_PARAMS = 2;
+const int PARAMS_PER_INSTRUMENT = 10;
+const char *PARAM_NAMES[] = {
+    "master_gain", "master_drive",
+    "bell_volume", "bell_attack", "bell_decay", "bell_sustain", "bell_release", "bell_oversampling", "bell_drive",
+    "bell_attack_curve", "bell_decay_curve", "bell_release_curve",
+    "harmonica_volume", "harmonica_attack", "harmonica_decay", "harmonica_sustain", "harmonica_release",
+    "harmonica_oversampling", "harmonica_drive", "harmonica_attack_curve", "harmonica_decay_curve",
+    "harmonica_release_curve",
+    "pure_saw_volume", "pure_saw_attack", "pure_saw_decay", "pure_saw_sustain", "pure_saw_release",
+    "pure_saw_oversampling", "pure_saw_drive", "pure_saw_attack_curve", "pure_saw_decay_curve",
+    "pure_saw_release_curve"
+};
+// the master bus is a single stream, it can afford the second order
+const int MASTER_ADAA_ORDER = 2;
+static_assert(sizeof(PARAM_NAMES) / sizeof(PARAM_NAMES[0]) == (int)ParamId::COUNT, "every parameter needs a name");
+
+
+static int16_t toSample(float sample)
+{
+    return (int16_t)std::max(-32768.0f, std::min(32767.0f, 32768.0f * sample));
+}
+
+size_t Engine::arenaSize(int render_threads, int max_notes, int max_frames)
+{
+    size_t mix_bytes = (max_frames * sizeof(float) + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+    return max_notes * (sizeof(Note) + 8 * sizeof(int)) + 3 * CACHE_LINE // notes and their two sets of voice links
+        + render_threads * (sizeof(RenderThread) + mix_bytes + PAGE_SIZE + VOICE_SCRATCH * sizeof(float) + CACHE_LINE)
+        + sizeof(RenderPool) + mix_bytes
+        + sizeof(WaveShaper) + (max_frames + MAX_ADAA_ORDER) * sizeof(float) + 2 * CACHE_LINE
+        + sizeof(LoudnessMeter) + CACHE_LINE
+        + 64 * 1024; // instruments and bookkeeping
+}
+
+Engine::Engine(int render_threads, int max_notes, int max_frames)
+    : arena(arenaSize(std::max(1, render_threads), max_notes, max_frames))
+{
+    initTables();
+    maxFrames = max_frames;
+    sampleNr = 0;
+    noteSeed = DEFAULT_NOISE_SEED;
+    masterGain = 1.0f;
+    masterDrive = 0.0f;
+    notes.init(arena, max_notes);
+    voices.init(arena, max_notes);
+    pool = arena.create<RenderPool>(arena, render_threads, max_frames);
+    scratch = arena.allocateArray<float>(max_frames, CACHE_LINE);
+    masterShaper = arena.create<WaveShaper>(arena, max_frames, MASTER_ADAA_ORDER);
+    meter = arena.create<LoudnessMeter>(1);
+    for (int i = 0; i < (int)InstrumentId::COUNT; ++i) {
+        instruments[i] = createInstrument(arena, (InstrumentId)i);
+    }
+    patch.store(instruments[(int)InstrumentId::BELL]);
+}
+
+bool Engine::ok() const
+{
+    return arena.ok() && pool && scratch && masterShaper && meter;
+}
+
+Instrument *createInstrument(Arena &arena, InstrumentId id)
+{
+    switch (id) {
+        case InstrumentId::BELL: return arena.create<Bell>();
+        case InstrumentId::HARMONICA: return arena.create<Harmonica>();
+        case InstrumentId::PURE_SAW: return arena.create<PureSaw>();
+        default: return nullptr;
+    }
+}
+
+Instrument *Engine::getInstrument(InstrumentId id)
+{
+    return id < InstrumentId::COUNT ? instruments[(int)id] : nullptr;
+}
+
+bool Engine::noteOn(int id, float hertz, Instrument *instrument)
+{
+    Note note;
+    note.id = id;
+    note.freq = hertz;
+    note.timeOn = getTime();
+    note.timeOff = -1.0f; // not released yet
+    note.active = true;
+    note.instrument = instrument;
+    // LCG step, the xorshift state of the note must not be zero
+    noteSeed = noteSeed * 1664525u + 1013904223u;
+    note.noiseState = noteSeed != 0 ? noteSeed : DEFAULT_NOISE_SEED;
+    return instrument && voices.start(notes, note);
+}
+
+bool Engine::noteOn(int id, float hertz)
+{
+    return noteOn(id, hertz, patch.load(std::memory_order_acquire));
+}
+
+void Engine::selectPatch(Instrument *instrument)
+{
+    patch.store(instrument, std::memory_order_release);
+}
+
+Instrument *Engine::getPatch() const
+{
+    return patch.load(std::memory_order_acquire);
+}
+
+bool Engine::setVoiceLimits(const Instrument *instrument, const VoiceLimits &limits)
+{
+    return voices.setLimits(instrument, limits);
+}
+
+VoiceLimits Engine::getVoiceLimits(const Instrument *instrument) const
+{
+    return voices.getLimits(instrument);
+}
+
+bool Engine::isPlaying(const Instrument *instrument) const
+{
+    return std::any_of(notes.begin(), notes.end(), [instrument](const Note &n){ return n.instrument == instrument; });
+}
+
+void Engine::noteOff(int id)
+{
+    float time = getTime();
+    for (Note &n : notes) {
+        if (n.id == id) {
+            n.timeOff = time;
+        }
+    }
+}
+
+void Engine::render(float *buffer, int frames)
+{
+    AudioRenderScope scope;
+    pool->render(notes, sampleNr, frames, buffer);
+    for (int done = 0; done < frames; done += maxFrames) {
+        finishBlock(buffer + done, std::min(maxFrames, frames - done));
+    }
+    sampleNr += frames;
+    voices.removeInactive(notes);
+}
+
+void Engine::render(int16_t *buffer, int frames)
+{
+    AudioRenderScope scope;
+    for (int done = 0; done < frames; done += maxFrames)
+    {
+        int length = std::min(maxFrames, frames - done);
+        pool->render(notes, sampleNr, length, scratch);
+        finishBlock(scratch, length);
+        for (int i = 0; i < length; ++i) {
+            buffer[done + i] = toSample(scratch[i]);
+        }
+        sampleNr += length;
+    }
+    voices.removeInactive(notes);
+}
+
+void Engine::finishBlock(float *mix, int length)
+{
+    const float gain = OUTPUT_GAIN * masterGain;
+    for (int i = 0; i < length; ++i) {
+        mix[i] *= gain;
+    }
+    masterShaper->process(mix, length, masterDrive);
+    meter->process(mix, length);
+}
+
+MeterReading Engine::readMeter() const
+{
+    return meter->read();
+}
+
+static float clampCurve(float value)
+{
+    return std::max(-MAX_ENVELOPE_CURVE, std::min(MAX_ENVELOPE_CURVE, value));
+}
+
+void Engine::setParam(ParamId id, float value)
+{
+    if (id >= ParamId::COUNT) {
+        return;
+    }
+    if (id == ParamId::MASTER_GAIN) {
+        masterGain = std::max(0.0f, value);
+        return;
+    }
+    if (id == ParamId::MASTER_DRIVE) {
+        masterDrive = std::max(0.0f, value);
+        return;
+    }
+    int index = (int)id - MASTER_PARAMS;
+    Instrument *instrument = instruments[index / PARAMS_PER_INSTRUMENT];
+    switch (index % PARAMS_PER_INSTRUMENT) {
+        case 0: instrument->volume = std::max(0.0f, value); break;
+        case 1: instrument->envelope.attackTime = std::max(MIN_SEGMENT_TIME, value); break;
+        case 2: instrument->envelope.decayTime = std::max(MIN_SEGMENT_TIME, value); break;
+        case 3: instrument->envelope.sustainAmplitude = std::max(0.0f, std::min(1.0f, value)); break;
+        case 4: instrument->envelope.releaseTime = std::max(MIN_SEGMENT_TIME, value); break;
+        case 5: instrument->oversampling = oversamplingFactor((int)value); break;
+        case 6: instrument->drive = std::max(0.0f, value); break;
+        case 7: instrument->envelope.attackCurve = clampCurve(value); break;
+        case 8: instrument->envelope.decayCurve = clampCurve(value); break;
+        case 9: instrument->envelope.releaseCurve = clampCurve(value); break;
+    }
+}
+
+float Engine::getParam(ParamId id)
+{
+    if (id >= ParamId::COUNT) {
+        return 0.0f;
+    }
+    if (id == ParamId::MASTER_GAIN) {
+        return masterGain;
+    }
+    if (id == ParamId::MASTER_DRIVE) {
+        return masterDrive;
+    }
+    int index = (int)id - MASTER_PARAMS;
+    Instrument *instrument = instruments[index / PARAMS_PER_INSTRUMENT];
+    switch (index % PARAMS_PER_INSTRUMENT) {
+        case 0: return instrument->volume;
+        case 1: return instrument->envelope.attackTime;
+        case 2: return instrument->envelope.decayTime;
+        case 3: return instrument->envelope.sustainAmplitude;
+        case 4: return instrument->envelope.releaseTime;
+        case 5: return (float)instrument->oversampling;
+        case 6: return instrument->drive;
+        case 7: return instrument->envelope.attackCurve;
+        case 8: return instrument->envelope.decayCurve;
+        default: return instrument->envelope.releaseCurve;
+    }
+}
+
+const char *Engine::getParamName(ParamId id)
+{
+    return id < ParamId::COUNT ? PARAM_NAMES[(int)id] : nullptr;
+}
+
+void Engine::seedNoise(uint32_t seed)
+{
+    noteSeed = seed;
+}
+
+void Engine::seek(int sample_nr)
+{
+    sampleNr = sample_nr;
+}
+
+void Engine::dropSilentNotes()
+{
+    if (sampleNr == 0) {
+        return;
+    }
+    // render() looks at the last rendered sample, the one before the clock
+    for (Note &n : notes) {
+        n.active = !n.instrument->envelope.isFinished((double)(sampleNr - 1) / SAMPLE_RATE, n.timeOn, n.timeOff);
+    }
+    voices.removeInactive(notes);
+}
+
+float Engine::getTime() const
+{
+    return (float)sampleNr / (float)SAMPLE_RATE;
+}
+
+int Engine::getActiveNotes() const
+{
+    return notes.size();
+}
+
+int Engine::getThreadCount() const
+{
+    return pool->getThreadCount();
+}
@@ -0,0 +1,122 @@
+#ifndef SYNTHY_ENGINE_H
+#define SYNTHY_ENGINE_H
+
+#include <atomic>
+#include <stdint.h>
+
+#include "arena.h"
+#include "config.h"
+#include "instrument.h"
+#include "meter.h"
+#include "note.h"
+#include "render_pool.h"
+#include "voice_allocator.h"
+#include "waveshaper.h"
+
+// the built in instruments, in the order getInstrument() returns them
+enum class InstrumentId
+{
+    BELL, HARMONICA, PURE_SAW, COUNT
+};
+
+// a new instrument of the given kind taken from the arena, with its default sound
+Instrument *createInstrument(Arena &arena, InstrumentId id);
+
+// automatable parameters; every instrument has the same ten, in the order of InstrumentId
+enum class ParamId
+{
+    MASTER_GAIN, MASTER_DRIVE,
+    BELL_VOLUME, BELL_ATTACK, BELL_DECAY, BELL_SUSTAIN, BELL_RELEASE, BELL_OVERSAMPLING, BELL_DRIVE,
+    BELL_ATTACK_CURVE, BELL_DECAY_CURVE, BELL_RELEASE_CURVE,
+    HARMONICA_VOLUME, HARMONICA_ATTACK, HARMONICA_DECAY, HARMONICA_SUSTAIN, HARMONICA_RELEASE, HARMONICA_OVERSAMPLING,
+    HARMONICA_DRIVE, HARMONICA_ATTACK_CURVE, HARMONICA_DECAY_CURVE, HARMONICA_RELEASE_CURVE,
+    PURE_SAW_VOLUME, PURE_SAW_ATTACK, PURE_SAW_DECAY, PURE_SAW_SUSTAIN, PURE_SAW_RELEASE, PURE_SAW_OVERSAMPLING,
+    PURE_SAW_DRIVE, PURE_SAW_ATTACK_CURVE, PURE_SAW_DECAY_CURVE, PURE_SAW_RELEASE_CURVE,
+    COUNT
+};
+
+// the whole synthesizer: instruments, notes and render threads, everything owned by one arena.
+// It is not thread safe, calls that change notes must not run concurrently with render()
+class Engine
+{
+public:
+    Engine(int render_threads = 1, int max_notes = MAX_NOTES, int max_frames = 4096);
+    
+    Engine(const Engine&) = delete;
+    Engine &operator=(const Engine&) = delete;
+    
+    // false when the engine did not get its memory, it must not be used then
+    bool ok() const;
+    
+    Instrument *getInstrument(InstrumentId id);
+    
+    // starts a note at the current time, returns false when the voice limits drop it.
+    // Ids are chosen by the caller, noteOff() releases every sounding note with the same id
+    bool noteOn(int id, float hertz, Instrument *instrument);
+    // plays the selected patch
+    bool noteOn(int id, float hertz);
+    void noteOff(int id);
+    
+    // the instrument noteOn(id, hertz) plays, the bell until another one is selected. Selecting is a single atomic
+    // store and may happen while render() runs; sounding notes keep the patch they started with
+    void selectPatch(Instrument *patch);
+    Instrument *getPatch() const;
+    // polyphony of instrument and its priority over others when the voices run out, see VoiceLimits. False when
+    // MAX_VOICE_GROUPS - 1 instruments have limits already; like notes, limits must not change while render() runs
+    bool setVoiceLimits(const Instrument *instrument, const VoiceLimits &limits);
+    VoiceLimits getVoiceLimits(const Instrument *instrument) const;
+    
+    // whether a note still sounds with instrument, so it can be reused; must not run concurrently with render()
+    bool isPlaying(const Instrument *instrument) const;
+    
+    // renders mono samples and drops the notes that went silent, full scale is 1.0 for float output
+    void render(float *buffer, int frames);
+    void render(int16_t *buffer, int frames);
+    
+    // values are clamped to what the instruments can play, times are in seconds.
+    // Like notes, parameters must not change while render() runs
+    void setParam(ParamId id, float value);
+    float getParam(ParamId id);
+    // lower case names like "bell_attack", nullptr for unknown ids
+    static const char *getParamName(ParamId id);
+    
+    // seeds the noise of the notes started from now on, for reproducible renders
+    void seedNoise(uint32_t seed);
+    
+    // levels of the output, measured after the master bus; any thread may call it, also while render() runs
+    MeterReading readMeter() const;
+    
+    // moves the clock to sample_nr without rendering, for offline renders of a range of a longer piece.
+    // Notes keep their times
+    void seek(int sample_nr);
+    // drops the notes whose envelope reached zero before the current time, the way render() drops the notes it
+    // rendered; replays of events between seek() calls need it so the same voices are free
+    void dropSilentNotes();
+    
+    // seconds of audio rendered so far
+    float getTime() const;
+    int getActiveNotes() const;
+    int getThreadCount() const;
+    
+private:
+    static size_t arenaSize(int render_threads, int max_notes, int max_frames);
+    // gain, master bus shaping and metering, in place; the result is at full scale 1.0
+    void finishBlock(float *mix, int length);
+    
+    Arena arena;
+    NoteList notes;
+    VoiceAllocator voices;
+    RenderPool *pool;
+    float *scratch; // float mix for the 16 bit output
+    int maxFrames;
+    int sampleNr;
+    uint32_t noteSeed;
+    float masterGain;
+    float masterDrive;
+    WaveShaper *masterShaper;
+    LoudnessMeter *meter;
+    Instrument *instruments[(int)InstrumentId::COUNT];
+    std::atomic<Instrument*> patch;
+};
+
+#endif
@@ -0,0 +1,136 @@
+#include "envelope.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// below this the curve is a straight line
+const float LINEAR_CURVE = 1e-3f;
+const double FOREVER = std::numeric_limits<double>::infinity();
+
+// 0..1 along a segment for x in 0..1: (1 - e^(-curve x)) / (1 - e^(-curve))
+static double curveShape(double x, float curve)
+{
+    if (std::fabs(curve) < LINEAR_CURVE) {
+        return x;
+    }
+    return (1.0 - std::exp(-curve * x)) / (1.0 - std::exp(-(double)curve));
+}
+
+static double segmentValue(const EnvelopeSegment &segment, double t)
+{
+    if (segment.from == segment.to) {
+        return segment.from;
+    }
+    double x = (t - segment.begin) / segment.length;
+    return segment.from + (segment.to - segment.from) * curveShape(x, segment.curve);
+}
+
+EnvelopeSegment EnvelopeADSR::heldSegment(double t, double timeOn) const
+{
+    double life_time = t - timeOn;
+    if (life_time < 0.0) {
+        return {-FOREVER, FOREVER, timeOn, 0.0f, 0.0f, 0.0f};
+    }
+    if (life_time <= attackTime) {
+        return {timeOn, attackTime, timeOn + attackTime, 0.0f, startAmplitude, attackCurve};
+    }
+    double decay_begin = timeOn + attackTime;
+    if (life_time <= attackTime + decayTime) {
+        return {decay_begin, decayTime, decay_begin + decayTime, startAmplitude, sustainAmplitude, decayCurve};
+    }
+    return {decay_begin + decayTime, FOREVER, FOREVER, sustainAmplitude, sustainAmplitude, 0.0f};
+}
+
+EnvelopeSegment EnvelopeADSR::segmentAt(double t, float timeOn, float timeOff) const
+{
+    if (timeOn > timeOff) {
+        return heldSegment(t, timeOn);
+    }
+    if (t < timeOff)
+    {
+        EnvelopeSegment segment = heldSegment(t, timeOn);
+        segment.end = std::min(segment.end, (double)timeOff);
+        return segment;
+    }
+    double release_end = (double)timeOff + releaseTime;
+    if (t > release_end) {
+        return {release_end, FOREVER, FOREVER, 0.0f, 0.0f, 0.0f};
+    }
+    float release_amplitude = (float)segmentValue(heldSegment(timeOff, timeOn), timeOff);
+    return {timeOff, releaseTime, release_end, release_amplitude, 0.0f, releaseCurve};
+}
+
+float EnvelopeADSR::getAmplitude(float t, float timeOn, float timeOff) const
+{
+    return std::max(0.0f, (float)segmentValue(segmentAt(t, timeOn, timeOff), t));
+}
+
+bool EnvelopeADSR::isFinished(double t, float timeOn, float timeOff) const
+{
+    EnvelopeSegment segment = segmentAt(t, timeOn, timeOff);
+    return t >= timeOn && segment.from <= 0.0f && segment.to <= 0.0f;
+}
+
+// along a segment the value moves towards an asymptote by the same factor every step,
+// v' = v * d + (1 - d) * asymptote with d = e^(-curve step / length); a straight line is v' = v + slope * step.
+// Every segment (and so every block) starts from the exact value, rounding does not add up over a note
+EnvelopeRun EnvelopeADSR::runAt(double t, int count, double step, float timeOn, float timeOff) const
+{
+    EnvelopeSegment segment = segmentAt(t, timeOn, timeOff);
+    EnvelopeRun run = {count, segmentValue(segment, t), 1.0, 0.0};
+    if (segment.end < FOREVER) {
+        run.steps = std::max(1, (int)std::min<double>(count, std::floor((segment.end - t) / step) + 1.0));
+    }
+    if (segment.from != segment.to)
+    {
+        double delta = segment.to - segment.from;
+        if (std::fabs(segment.curve) < LINEAR_CURVE) {
+            run.offset = delta * step / segment.length;
+        }
+        else {
+            double d = std::exp(-segment.curve * step / segment.length);
+            double asymptote = segment.from + delta / (1.0 - std::exp(-(double)segment.curve));
+            run.factor = d;
+            run.offset = (1.0 - d) * asymptote;
+        }
+    }
+    return run;
+}
+
+void EnvelopeADSR::getAmplitudes(float *out, int count, double start, double step, float timeOn, float timeOff) const
+{
+    int i = 0;
+    while (i < count)
+    {
+        EnvelopeRun run = runAt(start + i * step, count - i, step, timeOn, timeOff);
+        float value = (float)run.value;
+        const float factor = (float)run.factor;
+        const float offset = (float)run.offset;
+        for (int n = 0; n < run.steps; ++n) {
+            out[i + n] = std::max(0.0f, value);
+            value = value * factor + offset;
+        }
+        i += run.steps;
+    }
+}
+
+void EnvelopeADSR::getAmplitudesQ15(int16_t *out, int count, double start, double step, float timeOn,
+                                    float timeOff) const
+{
+    const double q30 = (double)(1 << 30);
+    int i = 0;
+    while (i < count)
+    {
+        EnvelopeRun run = runAt(start + i * step, count - i, step, timeOn, timeOff);
+        // the amplitudes stay within 0..1, Q30 leaves room for the factor 1.0 of straight lines
+        int32_t value = (int32_t)std::lrint(std::max(0.0, std::min(1.0, run.value)) * q30);
+        const int32_t factor = (int32_t)std::lrint(run.factor * q30);
+        const int32_t offset = (int32_t)std::lrint(run.offset * q30);
+        for (int n = 0; n < run.steps; ++n) {
+            out[i + n] = (int16_t)std::max(0, std::min(32767, value >> 15));
+            value = (int32_t)(((int64_t)value * factor) >> 30) + offset;
+        }
+        i += run.steps;
+    }
+}
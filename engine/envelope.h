@@ -0,0 +1,74 @@
+#ifndef SYNTHY_ENVELOPE_H
+#define SYNTHY_ENVELOPE_H
+
+#include <stdint.h>
+
+// the shortest envelope segment, the envelope divides by its times
+const float MIN_SEGMENT_TIME = 0.001f;
+// steepest segment curve, the curve parameters are clamped to +-this
+const float MAX_ENVELOPE_CURVE = 12.0f;
+
+// one piece of the envelope: from -> to over length seconds, applied until end
+struct EnvelopeSegment
+{
+    double begin;
+    double length;
+    double end;
+    float from;
+    float to;
+    float curve;
+};
+
+// samples along one segment: the first value, then value = value * factor + offset for every step
+struct EnvelopeRun
+{
+    int steps;
+    double value;
+    double factor;
+    double offset;
+};
+
+class EnvelopeADSR
+{
+public:
+    float attackTime;
+    float decayTime;
+    float releaseTime;
+    
+    float sustainAmplitude;
+    float startAmplitude;
+    
+    // shape of the segments: 0 is a straight line, positive values move fast at first and slowly at the end
+    // (exponential decay and release, a rounded attack), negative values the other way round
+    float attackCurve;
+    float decayCurve;
+    float releaseCurve;
+    
+    EnvelopeADSR()
+    {
+        attackTime = 0.01f;
+        decayTime = 1.0f;
+        startAmplitude = 1.0f;
+        sustainAmplitude = 0.0f;
+        releaseTime = 1.0f;
+        attackCurve = 0.0f;
+        decayCurve = 0.0f;
+        releaseCurve = 0.0f;
+    }
+    
+    float getAmplitude(float t, float timeOn, float timeOff) const;
+    // true once the envelope stays at zero from t on; the attack starts at zero, so a note that just started is not
+    bool isFinished(double t, float timeOn, float timeOff) const;
+    // the amplitudes at start, start + step, ... with one multiply-add per sample
+    void getAmplitudes(float *out, int count, double start, double step, float timeOn, float timeOff) const;
+    // the same in Q15, for the fixed point build; the recursion runs in Q30
+    void getAmplitudesQ15(int16_t *out, int count, double start, double step, float timeOn, float timeOff) const;
+    
+private:
+    EnvelopeSegment heldSegment(double t, double timeOn) const;
+    EnvelopeSegment segmentAt(double t, float timeOn, float timeOff) const;
+    // the run from t on, at most count steps
+    EnvelopeRun runAt(double t, int count, double step, float timeOn, float timeOff) const;
+};
+
+#endif
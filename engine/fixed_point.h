@@ -0,0 +1,78 @@
+#ifndef SYNTHY_FIXED_POINT_H
+#define SYNTHY_FIXED_POINT_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Q15 samples: 16 bits with 15 of them fraction, 1.0 is Q15_ONE. Eight fill the register that holds four floats,
+// through the same GCC/Clang vector extension as simd.h; arithmetic goes through 32 bits and saturates
+typedef int16_t q15x8 __attribute__((vector_size(16)));
+typedef int32_t int32x8 __attribute__((vector_size(32)));
+
+const int Q15_ONE = 32767;
+// the fixed point build renders notes at a quarter of full scale, instruments add up partials louder than 1.0
+const int FIXED_HEADROOM_BITS = 2;
+const float FIXED_SCALE = (float)(1 << (15 - FIXED_HEADROOM_BITS));
+// notes are mixed at half that, so eight of them at their peak fit the 16 bit mix; the float build clips its 16 bit
+// output before that, at about 6.5
+const int FIXED_MIX_SHIFT = 1;
+const float FIXED_MIX_SCALE = FIXED_SCALE / (1 << FIXED_MIX_SHIFT);
+
+inline int16_t saturateQ15(int32_t x)
+{
+    return (int16_t)(x < -32768 ? -32768 : (x > 32767 ? 32767 : x));
+}
+
+inline int16_t toQ15(float x)
+{
+    float scaled = x * 32768.0f;
+    return saturateQ15((int32_t)(scaled < -40000.0f ? -40000.0f : (scaled > 40000.0f ? 40000.0f : scaled)));
+}
+
+// rounded a * b, -1 * -1 saturates
+inline int16_t mulQ15(int16_t a, int16_t b)
+{
+    return saturateQ15(((int32_t)a * b + (1 << 14)) >> 15);
+}
+
+inline int16_t addQ15(int16_t a, int16_t b)
+{
+    return saturateQ15((int32_t)a + b);
+}
+
+inline q15x8 load8(const int16_t *p)
+{
+    q15x8 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline void store8(int16_t *p, q15x8 v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+inline q15x8 splat8(int16_t x)
+{
+    return q15x8{x, x, x, x, x, x, x, x};
+}
+
+inline q15x8 saturate8(int32x8 v)
+{
+    v = v < -32768 ? -32768 : v;
+    v = v > 32767 ? 32767 : v;
+    return __builtin_convertvector(v, q15x8);
+}
+
+inline q15x8 mul8(q15x8 a, q15x8 b)
+{
+    int32x8 product = __builtin_convertvector(a, int32x8) * __builtin_convertvector(b, int32x8);
+    return saturate8((product + (1 << 14)) >> 15);
+}
+
+inline q15x8 add8(q15x8 a, q15x8 b)
+{
+    return saturate8(__builtin_convertvector(a, int32x8) + __builtin_convertvector(b, int32x8));
+}
+
+#endif
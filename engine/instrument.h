@@ -0,0 +1,140 @@
+#ifndef SYNTHY_INSTRUMENT_H
+#define SYNTHY_INSTRUMENT_H
+
+#include <algorithm>
+#include <stdint.h>
+
+#include "envelope.h"
+#include "fixed_point.h"
+#include "oscillator.h"
+
+// floats every note keeps for instruments with state, like the filters of patches
+const int VOICE_STATE_FLOATS = 8;
+
+class Instrument
+{
+public:
+    float volume;
+    EnvelopeADSR envelope;
+    // 1, 2, 4 or 8; instruments with hard edges render that many samples per output sample to keep aliasing out
+    int oversampling;
+    // soft clipping of every note, 0 is off
+    float drive;
+    
+    Instrument()
+    {
+        volume = 1.0;
+        oversampling = 1;
+        drive = 0.0f;
+    }
+    virtual ~Instrument() {}
+    
+    // the oscillators of the instrument, without volume and envelope
+    virtual float wave(float hertz, float t)=0;
+    
+    // count samples of wave() at the times first / rate, (first + 1) / rate, ... into out, envelope holds the
+    // amplitudes at the same times. Instruments with state keep it in voice_state as it is at sample keep, where the
+    // next block of the note starts. The default calls wave() for every sample
+    virtual void renderWave(float hertz, int64_t first, double rate, int count, int keep, const float *envelope,
+                            float *voice_state, float *out)
+    {
+        for (int i = 0; i < count; ++i) {
+            out[i] = wave(hertz, (float)((double)(first + i) / rate));
+        }
+    }
+    
+    // wave() in Q15 at a quarter of full scale (FIXED_SCALE), used by the fixed point build. Returns false when the
+    // instrument has no fixed point oscillators, its notes are rendered in floats then
+    virtual bool renderWaveQ15(float hertz, int64_t first, double rate, int count, int16_t *out)
+    {
+        return false;
+    }
+};
+
+class Bell : public Instrument
+{
+public:
+    Bell()
+    {
+        envelope.attackTime = 0.01f;
+        envelope.decayTime = 1.0f;
+        envelope.startAmplitude = 1.0f;
+        envelope.sustainAmplitude = 0.0f;
+        envelope.releaseTime = 1.0f;
+    }
+    
+    float wave(float hertz, float t)
+    {
+        return (
+                                    + 1.0f * getWave(WaveType::SINE, t, hertz * 2.0f, 0.001f, 5.0f)
+                                    + 0.5f * getWave(WaveType::SINE, t, hertz * 3.0f)
+                                    + 0.25f * getWave(WaveType::SINE, t, hertz * 4.0f));
+    }
+    
+    bool renderWaveQ15(float hertz, int64_t first, double rate, int count, int16_t *out)
+    {
+        std::fill(out, out + count, 0);
+        addWaveQ15(WaveType::SINE, hertz * 2.0f, 0.001f, 5.0f, first, rate, count, Q15_ONE, out);
+        addWaveQ15(WaveType::SINE, hertz * 3.0f, 0.0f, 0.0f, first, rate, count, Q15_ONE / 2, out);
+        addWaveQ15(WaveType::SINE, hertz * 4.0f, 0.0f, 0.0f, first, rate, count, Q15_ONE / 4, out);
+        return true;
+    }
+};
+class Harmonica : public Instrument
+{
+public:
+    Harmonica()
+    {
+        envelope.attackTime = 0.1f;
+        envelope.decayTime = 0.01f;
+        envelope.startAmplitude = 1.0f;
+        envelope.sustainAmplitude = 0.8f;
+        envelope.releaseTime = 0.1f;
+    }
+    
+    float wave(float hertz, float t)
+    {
+        return (
+                                     + 1.0f * getWave(WaveType::SQUARE, t, hertz, 0.001f, 5.0f)
+                                     + 0.5f * getWave(WaveType::SQUARE, t, hertz * 1.5f)
+                                     + 0.25f * getWave(WaveType::SQUARE, t, hertz * 2.0f)
+                                     + 0.05f * getWave(WaveType::NOISE, t, 0.0f));
+    }
+    
+    bool renderWaveQ15(float hertz, int64_t first, double rate, int count, int16_t *out)
+    {
+        std::fill(out, out + count, 0);
+        addWaveQ15(WaveType::SQUARE, hertz, 0.001f, 5.0f, first, rate, count, Q15_ONE, out);
+        addWaveQ15(WaveType::SQUARE, hertz * 1.5f, 0.0f, 0.0f, first, rate, count, Q15_ONE / 2, out);
+        addWaveQ15(WaveType::SQUARE, hertz * 2.0f, 0.0f, 0.0f, first, rate, count, Q15_ONE / 4, out);
+        addWaveQ15(WaveType::NOISE, 0.0f, 0.0f, 0.0f, first, rate, count, Q15_ONE / 20, out);
+        return true;
+    }
+};
+class PureSaw : public Instrument
+{
+public:
+    PureSaw()
+    {
+        volume = 0.8;
+        envelope.attackTime = 0.01f;
+        envelope.decayTime = 0.01f;
+        envelope.startAmplitude = 1.0f;
+        envelope.sustainAmplitude = 0.8f;
+        envelope.releaseTime = 0.01f;
+    }
+    
+    float wave(float hertz, float t)
+    {
+        return getWave(WaveType::SAW, t, hertz, 0.001f, 5.0f);
+    }
+    
+    bool renderWaveQ15(float hertz, int64_t first, double rate, int count, int16_t *out)
+    {
+        std::fill(out, out + count, 0);
+        addWaveQ15(WaveType::SAW, hertz, 0.001f, 5.0f, first, rate, count, Q15_ONE, out);
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,78 @@
+#include "limiter.h"
+
+#include <algorithm>
+#include <math.h>
+
+#include "config.h"
+
+// frames of delay of upsample(), every stage delays by HALF_BAND_TAPS samples at its input rate
+static int upsampleLatency(int factor)
+{
+    int frames = 0;
+    for (int s = 0; (2 << s) <= factor; ++s) {
+        frames += HALF_BAND_TAPS >> s;
+    }
+    return frames;
+}
+
+TruePeakLimiter::TruePeakLimiter(Arena &arena, int max_frames, float ceiling_db, float release_ms)
+{
+    oversampler = arena.create<Oversampler>(arena, TRUE_PEAK_OVERSAMPLING, max_frames);
+    ceiling = powf(10.0f, ceiling_db / 20.0f);
+    releaseCoef = 1.0f - expf(-1000.0f / (release_ms * SAMPLE_RATE));
+    // a peak shows up in the oversampled signal this late, and the gain needs the look-ahead to get down to it
+    latency = upsampleLatency(TRUE_PEAK_OVERSAMPLING) + LIMITER_LOOKAHEAD;
+    delay = arena.allocateArray<float>(latency, CACHE_LINE);
+    delayPos = 0;
+    holdFront = 0;
+    holdCount = 0;
+    frameNr = 0;
+    released = 1.0f;
+    std::fill(window, window + LIMITER_LOOKAHEAD + 1, 1.0f);
+    windowPos = 0;
+    windowSum = LIMITER_LOOKAHEAD + 1;
+}
+
+void TruePeakLimiter::process(float *buffer, int frames)
+{
+    const int hold_size = LIMITER_LOOKAHEAD + 1;
+    const float *up = oversampler->upsample(buffer, frames);
+    for (int i = 0; i < frames; ++i)
+    {
+        // the half-band stages keep the input samples, every other oversampled value is one
+        float peak = 0.0f;
+        for (int k = 0; k < TRUE_PEAK_OVERSAMPLING; ++k) {
+            peak = std::max(peak, fabsf(up[i * TRUE_PEAK_OVERSAMPLING + k]));
+        }
+        float required = peak > ceiling ? ceiling / peak : 1.0f;
+        
+        // running minimum over the look-ahead: a queue of ascending gains, larger ones behind a new gain are useless.
+        // The expired front goes first, so the queue never holds more than hold_size gains
+        if (holdCount > 0 && holdAge[holdFront] <= frameNr - hold_size)
+        {
+            holdFront = (holdFront + 1) % hold_size;
+            holdCount--;
+        }
+        while (holdCount > 0 && hold[(holdFront + holdCount - 1) % hold_size] >= required) {
+            holdCount--;
+        }
+        hold[(holdFront + holdCount) % hold_size] = required;
+        holdAge[(holdFront + holdCount) % hold_size] = frameNr;
+        holdCount++;
+        float minimum = hold[holdFront];
+        frameNr++;
+        
+        // down at once, up slowly, never above the minimum; averaged over the look-ahead the gain reaches every
+        // required value right when its frame leaves the delay
+        released = minimum < released ? minimum : released + (minimum - released) * releaseCoef;
+        windowSum += released - window[windowPos];
+        window[windowPos] = released;
+        windowPos = (windowPos + 1) % hold_size;
+        float gain = (float)(windowSum / hold_size);
+        
+        float input = buffer[i];
+        buffer[i] = delay[delayPos] * gain;
+        delay[delayPos] = input;
+        delayPos = (delayPos + 1) % latency;
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef SYNTHY_LIMITER_H
+#define SYNTHY_LIMITER_H
+
+#include "arena.h"
+#include "oversampler.h"
+
+// Look-ahead limiter on the true peak: the level between the samples is estimated by 4x oversampling, as in
+// BS.1770, and the gain is lowered smoothly over the look-ahead before a peak, so no sample of the output goes above
+// the ceiling. The output is delayed by getLatency() frames
+const int TRUE_PEAK_OVERSAMPLING = 4;
+const int LIMITER_LOOKAHEAD = 64;
+
+class TruePeakLimiter
+{
+public:
+    TruePeakLimiter(Arena &arena, int max_frames, float ceiling_db = -1.0f, float release_ms = 50.0f);
+    
+    int getLatency() const
+    {
+        return latency;
+    }
+    
+    // in place, frames at most max_frames
+    void process(float *buffer, int frames);
+    
+private:
+    Oversampler *oversampler;
+    float ceiling;
+    float releaseCoef;
+    int latency;
+    // the input waiting for its gain, latency frames
+    float *delay;
+    int delayPos;
+    // gains required by the latest LIMITER_LOOKAHEAD + 1 frames, ascending from the front, for their running minimum
+    float hold[LIMITER_LOOKAHEAD + 1];
+    int holdAge[LIMITER_LOOKAHEAD + 1];
+    int holdFront;
+    int holdCount;
+    int frameNr;
+    float released; // the minimum, released slowly
+    // the moving average of released over the look-ahead, which is the gain
+    float window[LIMITER_LOOKAHEAD + 1];
+    int windowPos;
+    double windowSum;
+};
+
+#endif
@@ -0,0 +1,284 @@
+#include "meter.h"
+
+#include <algorithm>
+#include <math.h>
+
+// coefficients of BS.1770 for any sample rate, the analog prototypes go through the bilinear transform
+const double SHELF_HERTZ = 1681.974450955533;
+const double SHELF_GAIN_DB = 3.999843853973347;
+const double SHELF_Q = 0.7071752369554196;
+const double HIGH_PASS_HERTZ = 38.13547087602444;
+const double HIGH_PASS_Q = 0.5003270373238773;
+
+void BlockBiquad::init(double b0_, double b1_, double b2_, double a1_, double a2_)
+{
+    b0 = (float)b0_;
+    b1 = (float)b1_;
+    b2 = (float)b2_;
+    a1 = (float)a1_;
+    a2 = (float)a2_;
+    // the response of four steps to each state variable and to each input on its own
+    for (int column = 0; column < 6; ++column)
+    {
+        double state1 = column == 0 ? 1.0 : 0.0;
+        double state2 = column == 1 ? 1.0 : 0.0;
+        float4 response;
+        for (int n = 0; n < 4; ++n)
+        {
+            double x = column - 2 == n ? 1.0 : 0.0;
+            double y = b0_ * x + state1;
+            state1 = b1_ * x - a1_ * y + state2;
+            state2 = b2_ * x - a2_ * y;
+            response[n] = (float)y;
+        }
+        if (column < 2) {
+            stateColumns[column] = response;
+        }
+        else {
+            inputColumns[column - 2] = response;
+        }
+    }
+    reset();
+}
+
+void BlockBiquad::reset()
+{
+    s1 = 0.0f;
+    s2 = 0.0f;
+}
+
+void BlockBiquad::process(float *samples, int count)
+{
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        float4 x = load4(samples + i);
+        float4 y = stateColumns[0] * s1 + stateColumns[1] * s2
+                 + inputColumns[0] * x[0] + inputColumns[1] * x[1] + inputColumns[2] * x[2] + inputColumns[3] * x[3];
+        store4(samples + i, y);
+        // the state after the last two steps
+        s1 = b1 * x[3] - a1 * y[3] + b2 * x[2] - a2 * y[2];
+        s2 = b2 * x[3] - a2 * y[3];
+    }
+    for (; i < count; ++i)
+    {
+        float x = samples[i];
+        float y = b0 * x + s1;
+        s1 = b1 * x - a1 * y + s2;
+        s2 = b2 * x - a2 * y;
+        samples[i] = y;
+    }
+}
+
+float loudnessOf(double power)
+{
+    return power > 0.0 ? std::max(METER_FLOOR_LUFS, (float)(-0.691 + 10.0 * log10(power))) : METER_FLOOR_LUFS;
+}
+
+LoudnessMeter::LoudnessMeter(int channels_, int sample_rate)
+{
+    channels = std::max(1, std::min(MAX_METER_CHANNELS, channels_));
+    blockFrames = sample_rate * LOUDNESS_BLOCK_MS / 1000;
+    
+    double k = tan(M_PI * SHELF_HERTZ / sample_rate);
+    double vh = pow(10.0, SHELF_GAIN_DB / 20.0);
+    double vb = pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / SHELF_Q + k * k;
+    for (int c = 0; c < channels; ++c) {
+        shelf[c].init((vh + vb * k / SHELF_Q + k * k) / a0, 2.0 * (k * k - vh) / a0, (vh - vb * k / SHELF_Q + k * k) / a0,
+                      2.0 * (k * k - 1.0) / a0, (1.0 - k / SHELF_Q + k * k) / a0);
+    }
+    k = tan(M_PI * HIGH_PASS_HERTZ / sample_rate);
+    a0 = 1.0 + k / HIGH_PASS_Q + k * k;
+    for (int c = 0; c < channels; ++c) {
+        highPass[c].init(1.0, -2.0, 1.0, 2.0 * (k * k - 1.0) / a0, (1.0 - k / HIGH_PASS_Q + k * k) / a0);
+    }
+    sequence.store(0);
+    reset();
+}
+
+void LoudnessMeter::reset()
+{
+    for (int c = 0; c < channels; ++c)
+    {
+        shelf[c].reset();
+        highPass[c].reset();
+        peak[c] = 0.0f;
+        squares[c] = 0.0;
+    }
+    blockDone = 0;
+    weightedSquares = 0.0;
+    std::fill(powers, powers + SHORT_TERM_BLOCKS, 0.0);
+    blocks = 0;
+    MeterReading silence = {};
+    silence.momentary = METER_FLOOR_LUFS;
+    silence.shortTerm = METER_FLOOR_LUFS;
+    publish(silence);
+}
+
+void LoudnessMeter::process(const float *samples, int frames)
+{
+    while (frames > 0)
+    {
+        int now = std::min(frames, std::min(METER_CHUNK, blockFrames - blockDone));
+        measure(samples, now);
+        samples += now * channels;
+        frames -= now;
+        blockDone += now;
+        if (blockDone == blockFrames) {
+            finishBlock();
+        }
+    }
+}
+
+void LoudnessMeter::measure(const float *samples, int frames)
+{
+    for (int c = 0; c < channels; ++c)
+    {
+        for (int i = 0; i < frames; ++i) {
+            work[i] = samples[i * channels + c];
+        }
+        // peak and plain squares, four lanes and a scalar tail
+        float4 max4 = splat4(0.0f);
+        float4 sum4 = splat4(0.0f);
+        int i = 0;
+        for (; i + 4 <= frames; i += 4)
+        {
+            float4 x = load4(work + i);
+            float4 magnitude = x < 0.0f ? -x : x;
+            max4 = magnitude > max4 ? magnitude : max4;
+            sum4 += x * x;
+        }
+        float max1 = std::max(std::max(max4[0], max4[1]), std::max(max4[2], max4[3]));
+        float sum1 = sum4[0] + sum4[1] + sum4[2] + sum4[3];
+        for (; i < frames; ++i)
+        {
+            max1 = std::max(max1, fabsf(work[i]));
+            sum1 += work[i] * work[i];
+        }
+        peak[c] = std::max(peak[c], max1);
+        squares[c] += sum1;
+        
+        // K-weighted squares, every channel counts the same for mono and stereo
+        shelf[c].process(work, frames);
+        highPass[c].process(work, frames);
+        sum4 = splat4(0.0f);
+        for (i = 0; i + 4 <= frames; i += 4)
+        {
+            float4 x = load4(work + i);
+            sum4 += x * x;
+        }
+        sum1 = sum4[0] + sum4[1] + sum4[2] + sum4[3];
+        for (; i < frames; ++i) {
+            sum1 += work[i] * work[i];
+        }
+        weightedSquares += sum1;
+    }
+}
+
+void LoudnessMeter::finishBlock()
+{
+    powers[blocks % SHORT_TERM_BLOCKS] = weightedSquares / blockFrames;
+    blocks++;
+    
+    MeterReading reading = {};
+    for (int c = 0; c < channels; ++c)
+    {
+        reading.peak[c] = peak[c];
+        reading.rms[c] = (float)sqrt(squares[c] / blockFrames);
+        peak[c] = 0.0f;
+        squares[c] = 0.0;
+    }
+    double short_term = 0.0;
+    for (int b = 0; b < SHORT_TERM_BLOCKS; ++b) {
+        short_term += powers[b];
+    }
+    reading.momentary = loudnessOf(getMomentaryPower());
+    reading.shortTerm = loudnessOf(short_term / SHORT_TERM_BLOCKS);
+    reading.blocks = blocks;
+    publish(reading);
+    
+    blockDone = 0;
+    weightedSquares = 0.0;
+}
+
+double LoudnessMeter::getMomentaryPower() const
+{
+    double sum = 0.0;
+    for (int b = 1; b <= MOMENTARY_BLOCKS; ++b) {
+        sum += powers[(blocks + SHORT_TERM_BLOCKS - b) % SHORT_TERM_BLOCKS];
+    }
+    return sum / MOMENTARY_BLOCKS;
+}
+
+double LoudnessMeter::getBlockPower() const
+{
+    return powers[(blocks + SHORT_TERM_BLOCKS - 1) % SHORT_TERM_BLOCKS];
+}
+
+float integratedLoudness(const double *block_powers, int count)
+{
+    const double absolute_gate = pow(10.0, (-70.0 + 0.691) / 10.0);
+    double sum = 0.0;
+    int gated = 0;
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        // the second pass gates relative to the mean of the first
+        double gate = pass == 0 ? absolute_gate : std::max(absolute_gate, sum / std::max(1, gated) * 0.1);
+        sum = 0.0;
+        gated = 0;
+        double window = 0.0;
+        for (int b = 0; b < count; ++b)
+        {
+            window += block_powers[b] - (b >= MOMENTARY_BLOCKS ? block_powers[b - MOMENTARY_BLOCKS] : 0.0);
+            double power = window / MOMENTARY_BLOCKS;
+            if (b >= MOMENTARY_BLOCKS - 1 && power > gate)
+            {
+                sum += power;
+                gated++;
+            }
+        }
+    }
+    return gated > 0 ? loudnessOf(sum / gated) : METER_FLOOR_LUFS;
+}
+
+// a seqlock: odd while the writer changes the values, readers retry when it changed under them
+void LoudnessMeter::publish(const MeterReading &reading)
+{
+    uint32_t before = sequence.load(std::memory_order_relaxed);
+    sequence.store(before + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int c = 0; c < MAX_METER_CHANNELS; ++c)
+    {
+        published[2 * c].store(reading.peak[c], std::memory_order_relaxed);
+        published[2 * c + 1].store(reading.rms[c], std::memory_order_relaxed);
+    }
+    published[2 * MAX_METER_CHANNELS].store(reading.momentary, std::memory_order_relaxed);
+    published[2 * MAX_METER_CHANNELS + 1].store(reading.shortTerm, std::memory_order_relaxed);
+    publishedBlocks.store(reading.blocks, std::memory_order_relaxed);
+    sequence.store(before + 2, std::memory_order_release);
+}
+
+MeterReading LoudnessMeter::read() const
+{
+    MeterReading reading;
+    while (true)
+    {
+        uint32_t before = sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+        for (int c = 0; c < MAX_METER_CHANNELS; ++c)
+        {
+            reading.peak[c] = published[2 * c].load(std::memory_order_relaxed);
+            reading.rms[c] = published[2 * c + 1].load(std::memory_order_relaxed);
+        }
+        reading.momentary = published[2 * MAX_METER_CHANNELS].load(std::memory_order_relaxed);
+        reading.shortTerm = published[2 * MAX_METER_CHANNELS + 1].load(std::memory_order_relaxed);
+        reading.blocks = publishedBlocks.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) == before) {
+            return reading;
+        }
+    }
+}
@@ -0,0 +1,100 @@
+#ifndef SYNTHY_METER_H
+#define SYNTHY_METER_H
+
+#include <atomic>
+#include <stdint.h>
+
+#include "config.h"
+#include "simd.h"
+
+// Level metering of a bus: sample peak and RMS per channel, and EBU R128 momentary (400 ms) and short-term (3 s)
+// loudness over all channels. Everything is measured over blocks of 100 ms and published once per block
+const int MAX_METER_CHANNELS = 2;
+const int LOUDNESS_BLOCK_MS = 100;
+const int MOMENTARY_BLOCKS = 4;
+const int SHORT_TERM_BLOCKS = 30;
+// loudness of silence, instead of minus infinity
+const float METER_FLOOR_LUFS = -120.0f;
+// frames the K-weighting filters run on at a time
+const int METER_CHUNK = 256;
+
+struct MeterReading
+{
+    float peak[MAX_METER_CHANNELS]; // linear, 1.0 is full scale
+    float rms[MAX_METER_CHANNELS];
+    float momentary; // LUFS
+    float shortTerm;
+    uint64_t blocks; // published so far, 0 means nothing was measured yet
+};
+
+// a biquad in transposed direct form II, computed four samples at a time: the four outputs are a linear function of
+// the state and the four inputs, whose columns are worked out once from the coefficients
+class BlockBiquad
+{
+public:
+    void init(double b0, double b1, double b2, double a1, double a2);
+    void reset();
+    // in place
+    void process(float *samples, int count);
+    
+private:
+    float4 stateColumns[2];
+    float4 inputColumns[4];
+    float b0, b1, b2, a1, a2;
+    float s1, s2;
+};
+
+// the writer is the thread rendering the bus, any other thread can read()
+class LoudnessMeter
+{
+public:
+    LoudnessMeter(int channels, int sample_rate = SAMPLE_RATE);
+    
+    LoudnessMeter(const LoudnessMeter&) = delete;
+    LoudnessMeter& operator=(const LoudnessMeter&) = delete;
+    
+    // interleaved frames
+    void process(const float *samples, int frames);
+    void reset();
+    
+    // lock free, never blocks the writer
+    MeterReading read() const;
+    
+    int getChannels() const { return channels; }
+    // mean square of the K-weighted signal over the latest 400 ms, what integrated loudness is gated on
+    double getMomentaryPower() const;
+    // K-weighted mean square of the latest whole block, for integratedLoudness()
+    double getBlockPower() const;
+    uint64_t getBlocks() const { return blocks; }
+    
+private:
+    void measure(const float *samples, int frames);
+    void finishBlock();
+    void publish(const MeterReading &reading);
+    
+    int channels;
+    int blockFrames;
+    BlockBiquad shelf[MAX_METER_CHANNELS]; // stage 1 of the K-weighting, the head
+    BlockBiquad highPass[MAX_METER_CHANNELS]; // stage 2, RLB
+    alignas(CACHE_LINE) float work[METER_CHUNK];
+    // the block being measured
+    int blockDone;
+    float peak[MAX_METER_CHANNELS];
+    double squares[MAX_METER_CHANNELS];
+    double weightedSquares;
+    // K-weighted mean squares of the latest blocks
+    double powers[SHORT_TERM_BLOCKS];
+    uint64_t blocks;
+    
+    alignas(CACHE_LINE) std::atomic<uint32_t> sequence;
+    std::atomic<float> published[2 * MAX_METER_CHANNELS + 2];
+    std::atomic<uint64_t> publishedBlocks;
+};
+
+// LUFS of a K-weighted mean square
+float loudnessOf(double power);
+// BS.1770 integrated loudness of a whole piece from the K-weighted mean squares of its consecutive 100 ms blocks:
+// gating blocks of 400 ms overlapping by 75% are gated at -70 LUFS, then at 10 LU below the mean of the rest
+float integratedLoudness(const double *block_powers, int count);
+
+#endif
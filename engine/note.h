@@ -0,0 +1,89 @@
+#ifndef SYNTHY_NOTE_H
+#define SYNTHY_NOTE_H
+
+#include <algorithm>
+
+#include "arena.h"
+#include "config.h"
+#include "instrument.h"
+
+struct Note
+{
+    // hot: read for every rendered sample
+    float freq;
+    float timeOn;
+    float timeOff;
+    uint32_t noiseState; // every note has its own noise, independent of the thread rendering it
+    Instrument *instrument;
+    // written once per block by the thread rendering the note
+    bool active;
+    bool fixedPoint; // rendered in Q15, only in the fixed point build
+    // cold: only used by the key handling
+    int id;
+    // only used by instruments with state, sizeof(Note) is one cache line with it
+    float voiceState[VOICE_STATE_FLOATS];
+    
+    Note()
+    {
+        id = 0;
+        freq = 0.0f;
+        timeOn = 0.0f;
+        timeOff = 0.0f;
+        noiseState = DEFAULT_NOISE_SEED;
+        active = false;
+        fixedPoint = false;
+        instrument = nullptr;
+        std::fill(voiceState, voiceState + VOICE_STATE_FLOATS, 0.0f);
+    }
+};
+
+// fixed capacity note storage taken from the engine arena, so it never grows on the audio thread
+class NoteList
+{
+public:
+    NoteList()
+    {
+        notes = nullptr;
+        count = 0;
+        capacity = 0;
+    }
+    
+    void init(Arena &arena, int max_notes)
+    {
+        notes = arena.allocateArray<Note>(max_notes, CACHE_LINE);
+        capacity = notes ? max_notes : 0;
+        count = 0;
+    }
+    
+    // returns false (and drops the note) when every voice is in use
+    bool push(const Note &note)
+    {
+        if (count >= capacity) {
+            return false;
+        }
+        notes[count++] = note;
+        return true;
+    }
+    
+    // remove non-active notes, keeping the order of the others
+    void removeInactive()
+    {
+        count = (int)(std::remove_if(notes, notes + count, [](const Note& n){ return !n.active;}) - notes);
+    }
+    
+    Note *begin() { return notes; }
+    Note *end() { return notes + count; }
+    const Note *begin() const { return notes; }
+    const Note *end() const { return notes + count; }
+    Note *data() { return notes; }
+    int size() const { return count; }
+    int getCapacity() const { return capacity; }
+    bool empty() const { return count == 0; }
+    
+private:
+    Note *notes;
+    int count;
+    int capacity;
+};
+
+#endif
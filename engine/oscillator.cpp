@@ -0,0 +1,163 @@
+#include "oscillator.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+
+#include "config.h"
+#include "fixed_point.h"
+#include "tables.h"
+
+static thread_local uint32_t noise_state = DEFAULT_NOISE_SEED;
+
+void setNoiseSeed(uint32_t seed)
+{
+    noise_state = seed != 0 ? seed : DEFAULT_NOISE_SEED;
+}
+
+uint32_t getNoiseState()
+{
+    return noise_state;
+}
+
+float getNoise()
+{
+    noise_state ^= noise_state << 13;
+    noise_state ^= noise_state >> 17;
+    noise_state ^= noise_state << 5;
+    return 2.0f * (float)(noise_state >> 8) / (float)(1 << 24) - 1.0f;
+}
+
+// linear interpolation in a one cycle table, the phase is reduced in double so long notes keep their precision
+static float lookup(const float *table, float radians)
+{
+    double cycles = radians * (1.0 / (2.0 * M_PI));
+    double position = (cycles - floor(cycles)) * WAVE_TABLE_SIZE;
+    int index = (int)position;
+    float fraction = (float)(position - index);
+    index &= WAVE_TABLE_SIZE - 1;
+    return table[index] + fraction * (table[index + 1] - table[index]);
+}
+
+// oscilator function (with Frequency Modulation, FM)
+float getWave(WaveType wave_type, float t, float hertz, float fmAmplitude, float fmHertz)
+{
+    const Tables &tables = getTables();
+    float freq = H2W(hertz) * t + fmAmplitude * hertz * lookup(tables.sine, H2W(fmHertz) * t);
+    switch (wave_type) {
+        case WaveType::SINE:
+            return lookup(tables.sine, freq);
+            break;
+        case WaveType::SQUARE:
+            return lookup(tables.sine, freq) > 0 ? 1 : -1;
+            break;
+        case WaveType::TRIANGLE:
+            return asinf(lookup(tables.sine, freq)) * 2.0f / (float)M_PI;
+            break;
+        case WaveType::SAW:
+            return lookup(tables.saw, freq);
+            break;
+        case WaveType::NOISE:
+            return getNoise();
+            break;
+    }
+}
+
+float getPhase(float t, float hertz, float fmAmplitude, float fmHertz)
+{
+    return H2W(hertz) * t + fmAmplitude * hertz * lookup(getTables().sine, H2W(fmHertz) * t);
+}
+
+uint32_t phaseIncrement(float hertz, double rate)
+{
+    double cycles = hertz / rate;
+    return (uint32_t)(int64_t)llrint((cycles - floor(cycles)) * 4294967296.0);
+}
+
+// interpolates between the table samples with the 15 phase bits below the index
+static int16_t lookupQ15(const int16_t *table, uint32_t phase)
+{
+    uint32_t index = phase >> (32 - WAVE_TABLE_BITS);
+    int32_t fraction = (int32_t)((phase >> (32 - WAVE_TABLE_BITS - 15)) & 0x7fff);
+    return (int16_t)(table[index] + (((table[index + 1] - table[index]) * fraction) >> 15));
+}
+
+int16_t getWaveQ15(WaveType wave_type, uint32_t phase)
+{
+    const Tables &tables = getTables();
+    const int16_t quarter = (int16_t)FIXED_SCALE;
+    switch (wave_type) {
+        case WaveType::SINE:
+            return lookupQ15(tables.sineQ15, phase);
+        case WaveType::SQUARE:
+            // the sine is above zero over the first half of the cycle, no lookup needed
+            return phase - 1u < 0x80000000u ? quarter : -quarter;
+        case WaveType::TRIANGLE:
+        {
+            // asin(sin) is a triangle: up over the first quarter of the cycle, down over the next half
+            int32_t q = (int32_t)(phase >> 16);
+            int32_t triangle = q < 16384 ? 4 * q : (q < 49152 ? 131072 - 4 * q : 4 * q - 262144);
+            return (int16_t)(triangle >> (FIXED_HEADROOM_BITS + 1));
+        }
+        case WaveType::SAW:
+            return lookupQ15(tables.sawQ15, phase);
+        case WaveType::NOISE:
+            return (int16_t)lrintf(getNoise() * FIXED_SCALE);
+    }
+    return 0;
+}
+
+// getWave() puts square edges where its float phase rounds them, within 2^-21 of the phase (2048 of the 2^32 per
+// cycle); this phase drifts by half a step per sample and a few FM sine steps. Samples closer to an edge than both
+// take the float decision, so the edges land on the same samples in both builds. The drift grows with the clock,
+// past SQUARE_EDGE_LIMIT (18 s into a 440 Hz square) the tolerance stops growing: at most 1/64 of the samples pay
+// for getWave() and later edges may land a sample away from the float build, whose phase is off by then anyway
+static const double SQUARE_EDGE_LIMIT = 1 << 24;
+
+static int64_t fmDepthQ15(float hertz, float fmAmplitude)
+{
+    // fmAmplitude * hertz radians of FM are that over 2 pi cycles, the FM sine is at FIXED_SCALE
+    return llrint(fmAmplitude * hertz / (2.0 * M_PI) * 4294967296.0 / FIXED_SCALE);
+}
+
+static double squareEdgeTolerance(uint64_t n, double edge_step, double edge_fm)
+{
+    return std::min(n * edge_step, SQUARE_EDGE_LIMIT) + edge_fm;
+}
+
+double squareEdgeFloatShare(float hertz, float fmAmplitude, int64_t n, double rate)
+{
+    const double edge_fm = 4.0 * (double)llabs(fmDepthQ15(hertz, fmAmplitude));
+    double tolerance = squareEdgeTolerance(n, hertz / rate * 2048.0 + 1.0, edge_fm);
+    return std::min(1.0, 2.0 * tolerance / 2147483648.0);
+}
+
+void addWaveQ15(WaveType wave_type, float hertz, float fmAmplitude, float fmHertz, int64_t first, double rate,
+                int count, int16_t gain, int16_t *out)
+{
+    const uint32_t increment = phaseIncrement(hertz, rate);
+    const uint32_t fm_increment = phaseIncrement(fmHertz, rate);
+    const int64_t fm_depth = fmDepthQ15(hertz, fmAmplitude);
+    const int16_t quarter = (int16_t)FIXED_SCALE;
+    const double edge_step = hertz / rate * 2048.0 + 1.0;
+    const double edge_fm = 4.0 * (double)llabs(fm_depth);
+    for (int i = 0; i < count; ++i)
+    {
+        uint64_t n = (uint64_t)(first + i);
+        uint32_t phase = (uint32_t)(n * increment);
+        if (fm_depth != 0) {
+            phase += (uint32_t)(fm_depth * lookupQ15(getTables().sineQ15, (uint32_t)(n * fm_increment)));
+        }
+        int16_t wave = getWaveQ15(wave_type, phase);
+        if (wave_type == WaveType::SQUARE)
+        {
+            uint32_t half = phase & 0x7fffffffu;
+            if (std::min(half, 0x80000000u - half) <= squareEdgeTolerance(n, edge_step, edge_fm))
+            {
+                float t = (float)((double)n / rate);
+                wave = getWave(WaveType::SQUARE, t, hertz, fmAmplitude, fmHertz) > 0 ? quarter : -quarter;
+            }
+        }
+        out[i] = addQ15(out[i], mulQ15(wave, gain));
+    }
+}
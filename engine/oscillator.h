@@ -0,0 +1,35 @@
+#ifndef SYNTHY_OSCILLATOR_H
+#define SYNTHY_OSCILLATOR_H
+
+#include <stdint.h>
+
+enum class WaveType
+{
+    SINE, SQUARE, TRIANGLE, SAW, NOISE
+};
+
+// noise generator state is one xorshift32 per thread, seeded so offline renders are reproducible.
+// Notes carry their own state, which is swapped in while they render
+const uint32_t DEFAULT_NOISE_SEED = 2463534242u;
+
+// seeds the noise of the calling thread
+void setNoiseSeed(uint32_t seed);
+uint32_t getNoiseState();
+float getNoise();
+
+// oscilator function (with Frequency Modulation, FM)
+float getWave(WaveType wave_type, float t, float hertz, float fmAmplitude=0, float fmHertz=0);
+// fixed point oscillators: the phase is a 32 bit fraction of a cycle, so it wraps around exactly.
+// The samples are Q15 at a quarter of full scale (FIXED_SCALE), like the tables
+uint32_t phaseIncrement(float hertz, double rate);
+int16_t getWaveQ15(WaveType wave_type, uint32_t phase);
+// count samples of getWave() from sample first on, times gain (Q15), added to out with saturation
+void addWaveQ15(WaveType wave_type, float hertz, float fmAmplitude, float fmHertz, int64_t first, double rate,
+                int count, int16_t gain, int16_t *out);
+// share of a square's samples around sample n that addWaveQ15() hands to getWave() to place the edges
+double squareEdgeFloatShare(float hertz, float fmAmplitude, int64_t n, double rate);
+
+// the angle in radians getWave() reads its table at
+float getPhase(float t, float hertz, float fmAmplitude=0, float fmHertz=0);
+
+#endif
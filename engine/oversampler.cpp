@@ -0,0 +1,142 @@
+#include "oversampler.h"
+
+#include <algorithm>
+
+#include "simd.h"
+
+int oversamplingFactor(int factor)
+{
+    return factor >= 8 ? 8 : factor >= 4 ? 4 : factor >= 2 ? 2 : 1;
+}
+
+int oversamplingMargin(int factor)
+{
+    return HALF_BAND_LENGTH * (oversamplingFactor(factor) - 1);
+}
+
+// splits the samples of one stage into its even and odd polyphase branches
+static void deinterleave(const float *in, int count, float *even, float *odd)
+{
+    for (int i = 0; i < count / 2; ++i) {
+        even[i] = in[2 * i];
+        odd[i] = in[2 * i + 1];
+    }
+    if (count & 1) {
+        even[count / 2] = in[count - 1];
+    }
+}
+
+// out[m] = 0.5 * in[2m + L] + sum of taps[j] * (in[2m + L - 2j - 1] + in[2m + L + 2j + 1]), for the 2 * frames + 2L
+// samples of in. The center is an odd sample and every other tap an even one
+static void halfBandDecimate(const float *in, int frames, float *scratch, float *out)
+{
+    const float *taps = getTables().halfBand;
+    const int count = 2 * frames + 2 * HALF_BAND_LENGTH;
+    float *even = scratch;
+    float *odd = scratch + (count + 1) / 2;
+    deinterleave(in, count, even, odd);
+    
+    const float *center = odd + HALF_BAND_TAPS - 1;
+    int m = 0;
+    for (; m + 4 <= frames; m += 4)
+    {
+        float4 sum = splat4(0.5f) * load4(center + m);
+        for (int j = 0; j < HALF_BAND_TAPS; ++j) {
+            sum += splat4(taps[j]) * (load4(even + m + HALF_BAND_TAPS - 1 - j) + load4(even + m + HALF_BAND_TAPS + j));
+        }
+        store4(out + m, sum);
+    }
+    for (; m < frames; ++m)
+    {
+        float sum = 0.5f * center[m];
+        for (int j = 0; j < HALF_BAND_TAPS; ++j) {
+            sum += taps[j] * (even[m + HALF_BAND_TAPS - 1 - j] + even[m + HALF_BAND_TAPS + j]);
+        }
+        out[m] = sum;
+    }
+}
+
+// out[2m] = in[m + T - 1], out[2m + 1] = the half-band interpolation between in[m + T - 1] and in[m + T],
+// for the frames + 2T - 1 samples of in
+static void halfBandInterpolate(const float *in, int frames, float *scratch, float *out)
+{
+    const float *taps = getTables().halfBand;
+    const float *center = in + HALF_BAND_TAPS - 1;
+    float *between = scratch;
+    int m = 0;
+    for (; m + 4 <= frames; m += 4)
+    {
+        float4 sum = splat4(0.0f);
+        for (int j = 0; j < HALF_BAND_TAPS; ++j) {
+            sum += splat4(2.0f * taps[j]) * (load4(center + m - j) + load4(center + m + 1 + j));
+        }
+        store4(between + m, sum);
+    }
+    for (; m < frames; ++m)
+    {
+        float sum = 0.0f;
+        for (int j = 0; j < HALF_BAND_TAPS; ++j) {
+            sum += 2.0f * taps[j] * (center[m - j] + center[m + 1 + j]);
+        }
+        between[m] = sum;
+    }
+    for (m = 0; m < frames; ++m) {
+        out[2 * m] = center[m];
+        out[2 * m + 1] = between[m];
+    }
+}
+
+void decimateBlock(float *in, int frames, int factor, float *scratch, float *out)
+{
+    factor = oversamplingFactor(factor);
+    // every stage keeps the margin its successors still need, so the outputs of a stage are the inputs of the next
+    int margin = oversamplingMargin(factor);
+    for (int rate = factor; rate > 1; rate /= 2)
+    {
+        margin = (margin - HALF_BAND_LENGTH) / 2;
+        int stage_frames = frames * rate / 2 + 2 * margin;
+        halfBandDecimate(in, stage_frames, scratch, in);
+    }
+    for (int i = 0; i < frames; ++i) {
+        out[i] += in[i];
+    }
+}
+
+Oversampler::Oversampler(Arena &arena, int factor, int max_frames)
+{
+    this->factor = oversamplingFactor(factor);
+    stages = 0;
+    for (int rate = 1; rate < this->factor; rate *= 2) {
+        stages++;
+    }
+    maxFrames = max_frames;
+    for (int s = 0; s < stages; ++s)
+    {
+        // stage s turns max_frames << s samples into twice as many
+        int frames = max_frames << s;
+        upInput[s] = arena.allocateArray<float>(frames + 2 * HALF_BAND_TAPS - 1, CACHE_LINE);
+    }
+    upOutput = arena.allocateArray<float>(this->factor * max_frames, CACHE_LINE);
+    scratch = arena.allocateArray<float>(this->factor * max_frames + 2 * HALF_BAND_LENGTH + 1, CACHE_LINE);
+}
+
+float *Oversampler::upsample(const float *in, int frames)
+{
+    if (stages == 0) {
+        std::copy(in, in + frames, upOutput);
+        return upOutput;
+    }
+    const int history = 2 * HALF_BAND_TAPS - 1;
+    const float *source = in;
+    for (int s = 0; s < stages; ++s)
+    {
+        int count = frames << s;
+        float *input = upInput[s];
+        std::copy(source, source + count, input + history);
+        halfBandInterpolate(input, count, scratch, upOutput);
+        std::copy(input + count, input + count + history, input);
+        // the next stage copies this output into its own input before overwriting it
+        source = upOutput;
+    }
+    return upOutput;
+}
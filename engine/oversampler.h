@@ -0,0 +1,47 @@
+#ifndef SYNTHY_OVERSAMPLER_H
+#define SYNTHY_OVERSAMPLER_H
+
+#include "arena.h"
+#include "tables.h"
+
+// Oversampling by 2, 4 or 8 with a cascade of 2x half-band FIR stages. Each stage is split into its two polyphase
+// branches, so only the non-zero taps are computed, four outputs at a time.
+const int MAX_OVERSAMPLING = 8;
+// input samples of one stage on either side of the center of its filter
+const int HALF_BAND_LENGTH = 2 * HALF_BAND_TAPS - 1;
+
+// the factor rounded down to 1, 2, 4 or 8
+int oversamplingFactor(int factor);
+// oversampled samples a block needs before its first and after its last frame
+int oversamplingMargin(int factor);
+
+// For sources that can be rendered at any time, like notes: decimates factor * frames + 2 * margin oversampled
+// samples, starting margin samples before the block, to frames samples added to out. No state is kept between
+// blocks and the output is not delayed. in is overwritten, scratch holds as many floats as in
+void decimateBlock(float *in, int frames, int factor, float *scratch, float *out);
+
+// for streams, like effects on the mix: keeps the filter history between blocks
+class Oversampler
+{
+public:
+    Oversampler(Arena &arena, int factor, int max_frames);
+    
+    int getFactor() const
+    {
+        return factor;
+    }
+    
+    // turns frames samples (at most max_frames) into factor * frames, the result is valid until the next call
+    float *upsample(const float *in, int frames);
+    
+private:
+    int factor;
+    int stages;
+    int maxFrames;
+    // per stage: input with the history of the last block in front of it
+    float *upInput[3];
+    float *upOutput; // factor * max_frames
+    float *scratch;
+};
+
+#endif
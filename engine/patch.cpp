@@ -0,0 +1,487 @@
+#include "patch.h"
+
+#include <algorithm>
+#include <map>
+#include <math.h>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "preset_bank.h"
+
+// lowest cutoff of the filters, and the highest as part of the rate
+const float MIN_CUTOFF_HERTZ = 10.0f;
+const float MAX_CUTOFF_RATIO = 0.49f;
+
+PatchInstrument::PatchInstrument()
+{
+    opCount = 0;
+    output = -1;
+    tableFormat = TableFormat::FLOAT;
+}
+
+// state variable filter in the topology preserving form, stable however fast the cutoff moves. state is its two
+// integrators; when the next block starts at keep_at, their values there go to kept
+static void runFilter(const PatchOp &op, const float *in, const float *cutoff, float *out, int count, double rate,
+                      float *state, int keep_at, float *kept)
+{
+    const float k = 1.0f / op.value;
+    float ic1 = state[0], ic2 = state[1];
+    float last_cutoff = -1.0f;
+    float a1 = 0.0f, a2 = 0.0f, a3 = 0.0f;
+    for (int i = 0; i < count; ++i)
+    {
+        if (i == keep_at)
+        {
+            kept[0] = ic1;
+            kept[1] = ic2;
+        }
+        if (cutoff[i] != last_cutoff)
+        {
+            last_cutoff = cutoff[i];
+            float hertz = std::max(MIN_CUTOFF_HERTZ, std::min(MAX_CUTOFF_RATIO * (float)rate, cutoff[i]));
+            float g = tanf((float)M_PI * hertz / (float)rate);
+            a1 = 1.0f / (1.0f + g * (g + k));
+            a2 = g * a1;
+            a3 = g * a2;
+        }
+        float v0 = in[i];
+        float v3 = v0 - ic2;
+        float v1 = a1 * ic1 + a2 * v3;
+        float v2 = ic2 + a2 * ic1 + a3 * v3;
+        ic1 = 2.0f * v1 - ic1;
+        ic2 = 2.0f * v2 - ic2;
+        switch (op.mode) {
+            case FilterMode::LOWPASS: out[i] = v2; break;
+            case FilterMode::BANDPASS: out[i] = v1; break;
+            case FilterMode::HIGHPASS: out[i] = v0 - k * v1 - v2; break;
+        }
+    }
+    state[0] = ic1;
+    state[1] = ic2;
+}
+
+void PatchInstrument::renderWave(float hertz, int64_t first, double rate, int count, int keep, const float *envelope,
+                                 float *voice_state, float *out)
+{
+    if (output < 0)
+    {
+        std::fill(out, out + count, 0.0f);
+        return;
+    }
+    alignas(CACHE_LINE) float registers[MAX_PATCH_REGISTERS][PATCH_BLOCK];
+    float state[VOICE_STATE_FLOATS];
+    float kept[VOICE_STATE_FLOATS];
+    std::copy(voice_state, voice_state + VOICE_STATE_FLOATS, state);
+    std::copy(voice_state, voice_state + VOICE_STATE_FLOATS, kept);
+    for (int base = 0; base < count; base += PATCH_BLOCK)
+    {
+        const int n = std::min(PATCH_BLOCK, count - base);
+        for (int o = 0; o < opCount; ++o)
+        {
+            const PatchOp &op = ops[o];
+            float *target = registers[op.target];
+            const float *a = registers[op.a];
+            const float *b = registers[op.b];
+            switch (op.code) {
+                case PatchOpCode::CONST:
+                    // nothing else writes the register
+                    if (base == 0) {
+                        std::fill(target, target + PATCH_BLOCK, op.value);
+                    }
+                    break;
+                case PatchOpCode::OSC:
+                    for (int i = 0; i < n; ++i)
+                    {
+                        float time = (float)((double)(first + base + i) / rate);
+                        target[i] = getWave(op.wave, time, hertz * op.value, op.fmAmplitude, op.fmHertz);
+                    }
+                    break;
+                case PatchOpCode::TABLE_OSC:
+                    renderWaveTable({tables[op.filter], tableFormat}, hertz * op.value, op.fmAmplitude, op.fmHertz,
+                                    first + base, rate, n, target);
+                    break;
+                case PatchOpCode::ENV:
+                    std::copy(envelope + base, envelope + base + n, target);
+                    break;
+                case PatchOpCode::MUL:
+                    for (int i = 0; i < n; ++i) {
+                        target[i] = a[i] * b[i];
+                    }
+                    break;
+                case PatchOpCode::ADD:
+                    for (int i = 0; i < n; ++i) {
+                        target[i] = a[i] + b[i];
+                    }
+                    break;
+                case PatchOpCode::FILTER:
+                    runFilter(op, a, b, target, n, rate, state + 2 * op.filter, keep - base, kept + 2 * op.filter);
+                    break;
+            }
+        }
+        std::copy(registers[output], registers[output] + n, out + base);
+    }
+    if (keep >= count) {
+        std::copy(state, state + VOICE_STATE_FLOATS, kept);
+    }
+    std::copy(kept, kept + VOICE_STATE_FLOATS, voice_state);
+}
+
+float PatchInstrument::wave(float hertz, float t)
+{
+    if (output < 0) {
+        return 0.0f;
+    }
+    float registers[MAX_PATCH_REGISTERS];
+    for (int o = 0; o < opCount; ++o)
+    {
+        const PatchOp &op = ops[o];
+        switch (op.code) {
+            case PatchOpCode::CONST: registers[op.target] = op.value; break;
+            case PatchOpCode::OSC:
+                registers[op.target] = getWave(op.wave, t, hertz * op.value, op.fmAmplitude, op.fmHertz);
+                break;
+            case PatchOpCode::TABLE_OSC:
+                registers[op.target] = getTableWave({tables[op.filter], tableFormat}, t, hertz * op.value, op.fmAmplitude, op.fmHertz);
+                break;
+            case PatchOpCode::ENV: registers[op.target] = 1.0f; break;
+            case PatchOpCode::MUL: registers[op.target] = registers[op.a] * registers[op.b]; break;
+            case PatchOpCode::ADD: registers[op.target] = registers[op.a] + registers[op.b]; break;
+            case PatchOpCode::FILTER: registers[op.target] = registers[op.a]; break;
+        }
+    }
+    return registers[output];
+}
+
+// ---------------------------------------------------------------------------
+// Compiler
+// ---------------------------------------------------------------------------
+
+struct PatchCompiler
+{
+    PatchInstrument compiled;
+    PatchOp ops[MAX_PATCH_OPS];
+    int opCount = 0;
+    int registers = 0;
+    int filters = 0;
+    int tables = 0;
+    int output = -1;
+    std::map<std::string, int> names;
+    std::map<std::string, int> tableNames;
+    float tableSamples[MAX_PATCH_TABLES][WAVE_TABLE_SIZE + 1];
+    TableFormat tableFormat = TableFormat::FLOAT;
+    Preset settings;
+    std::string message;
+    
+    bool fail(const std::string &why)
+    {
+        message = why;
+        return false;
+    }
+    
+    bool addOp(const PatchOp &op)
+    {
+        if (opCount == MAX_PATCH_OPS) {
+            return fail("more than " + std::to_string(MAX_PATCH_OPS) + " operations");
+        }
+        ops[opCount++] = op;
+        return true;
+    }
+    
+    bool newRegister(int &reg)
+    {
+        if (registers == MAX_PATCH_REGISTERS) {
+            return fail("more than " + std::to_string(MAX_PATCH_REGISTERS) + " signals");
+        }
+        reg = registers++;
+        return true;
+    }
+    
+    static bool parseNumber(const std::string &token, float &value)
+    {
+        char *end = nullptr;
+        value = strtof(token.c_str(), &end);
+        return !token.empty() && *end == '\0';
+    }
+    
+    // a name assigned before, or a number that becomes a constant
+    bool operand(const std::string &token, int &reg)
+    {
+        auto it = names.find(token);
+        if (it != names.end())
+        {
+            reg = it->second;
+            return true;
+        }
+        float value;
+        if (!parseNumber(token, value)) {
+            return fail("unknown signal '" + token + "'");
+        }
+        PatchOp op = {};
+        op.code = PatchOpCode::CONST;
+        op.value = value;
+        if (!newRegister(reg)) {
+            return false;
+        }
+        op.target = (uint8_t)reg;
+        return addOp(op);
+    }
+    
+    bool number(const std::string &token, float &value)
+    {
+        return parseNumber(token, value) || fail("'" + token + "' is not a number");
+    }
+    
+    // table_format float|int16|half
+    bool format(const std::vector<std::string> &tokens)
+    {
+        static const std::map<std::string, TableFormat> formats = {
+            {"float", TableFormat::FLOAT}, {"int16", TableFormat::INT16}, {"half", TableFormat::HALF}
+        };
+        auto it = tokens.size() == 2 ? formats.find(tokens[1]) : formats.end();
+        if (it == formats.end()) {
+            return fail("table_format is float, int16 or half");
+        }
+        tableFormat = it->second;
+        return true;
+    }
+    
+    // name value, the settings are clamped like the engine parameters when the patch is done
+    bool parameter(const std::vector<std::string> &tokens)
+    {
+        static const std::map<std::string, float Preset::*> fields = {
+            {"volume", &Preset::volume}, {"attack", &Preset::attackTime}, {"decay", &Preset::decayTime},
+            {"sustain", &Preset::sustainAmplitude}, {"release", &Preset::releaseTime},
+            {"attack_curve", &Preset::attackCurve}, {"decay_curve", &Preset::decayCurve},
+            {"release_curve", &Preset::releaseCurve}, {"drive", &Preset::drive}
+        };
+        static const std::map<std::string, int VoiceLimits::*> limits = {
+            {"max_voices", &VoiceLimits::maxVoices}, {"priority", &VoiceLimits::priority},
+            {"reserved_voices", &VoiceLimits::reserved}
+        };
+        auto field = fields.find(tokens[0]);
+        auto limit = limits.find(tokens[0]);
+        if (field == fields.end() && limit == limits.end() && tokens[0] != "oversampling") {
+            return fail("unknown statement '" + tokens[0] + "'");
+        }
+        float value;
+        if (tokens.size() != 2) {
+            return fail(tokens[0] + " takes one value");
+        }
+        if (!number(tokens[1], value)) {
+            return false;
+        }
+        if (field != fields.end()) {
+            settings.*(field->second) = value;
+        }
+        else if (limit != limits.end()) {
+            compiled.voiceLimits.*(limit->second) = (int)value;
+        }
+        else {
+            settings.oversampling = (int32_t)value;
+        }
+        return true;
+    }
+    
+    // name = table amplitudes..., a wave of the given harmonics normalized to a peak of 1
+    bool table(const std::string &name, const std::vector<std::string> &args)
+    {
+        if (args.empty() || args.size() > (size_t)MAX_TABLE_HARMONICS) {
+            return fail("table takes 1 to " + std::to_string(MAX_TABLE_HARMONICS) + " harmonics");
+        }
+        if (tables == MAX_PATCH_TABLES) {
+            return fail("more than " + std::to_string(MAX_PATCH_TABLES) + " tables");
+        }
+        if (names.count(name)) {
+            return fail("'" + name + "' is a signal");
+        }
+        float amplitudes[MAX_TABLE_HARMONICS];
+        for (size_t h = 0; h < args.size(); ++h) {
+            if (!number(args[h], amplitudes[h])) {
+                return false;
+            }
+        }
+        float *samples = tableSamples[tables];
+        double peak = 0.0;
+        for (int i = 0; i < WAVE_TABLE_SIZE; ++i)
+        {
+            double phase = 2.0 * M_PI * i / WAVE_TABLE_SIZE;
+            double sum = 0.0;
+            for (size_t h = 0; h < args.size(); ++h) {
+                sum += amplitudes[h] * sin((h + 1) * phase);
+            }
+            samples[i] = (float)sum;
+            peak = std::max(peak, fabs(sum));
+        }
+        if (peak == 0.0) {
+            return fail("table '" + name + "' is silent");
+        }
+        for (int i = 0; i < WAVE_TABLE_SIZE; ++i) {
+            samples[i] = (float)(samples[i] / peak);
+        }
+        samples[WAVE_TABLE_SIZE] = samples[0];
+        tableNames[name] = tables++;
+        return true;
+    }
+    
+    // name = op operands...
+    bool assignment(const std::vector<std::string> &tokens)
+    {
+        if (tokens.size() < 3) {
+            return fail("nothing assigned to '" + tokens[0] + "'");
+        }
+        const std::string &code = tokens[2];
+        std::vector<std::string> args(tokens.begin() + 3, tokens.end());
+        PatchOp op = {};
+        if (code == "osc")
+        {
+            static const std::map<std::string, WaveType> waves = {
+                {"sine", WaveType::SINE}, {"square", WaveType::SQUARE}, {"triangle", WaveType::TRIANGLE},
+                {"saw", WaveType::SAW}, {"noise", WaveType::NOISE}
+            };
+            if (args.size() != 2 && args.size() != 4) {
+                return fail("osc takes a wave, a ratio and optionally an FM amount and hertz");
+            }
+            auto wave = waves.find(args[0]);
+            auto table = tableNames.find(args[0]);
+            if (wave != waves.end())
+            {
+                op.code = PatchOpCode::OSC;
+                op.wave = wave->second;
+            }
+            else if (table != tableNames.end())
+            {
+                op.code = PatchOpCode::TABLE_OSC;
+                op.filter = (uint8_t)table->second;
+            }
+            else {
+                return fail("unknown wave '" + args[0] + "'");
+            }
+            if (!number(args[1], op.value)) {
+                return false;
+            }
+            if (args.size() == 4 && (!number(args[2], op.fmAmplitude) || !number(args[3], op.fmHertz))) {
+                return false;
+            }
+        }
+        else if (code == "table") {
+            return table(tokens[0], args);
+        }
+        else if (code == "env")
+        {
+            if (!args.empty()) {
+                return fail("env takes nothing");
+            }
+            op.code = PatchOpCode::ENV;
+        }
+        else if (code == "mul" || code == "add")
+        {
+            int a, b;
+            if (args.size() != 2) {
+                return fail(code + " takes two signals");
+            }
+            if (!operand(args[0], a) || !operand(args[1], b)) {
+                return false;
+            }
+            op.code = code == "mul" ? PatchOpCode::MUL : PatchOpCode::ADD;
+            op.a = (uint8_t)a;
+            op.b = (uint8_t)b;
+        }
+        else if (code == "filter")
+        {
+            static const std::map<std::string, FilterMode> modes = {
+                {"lowpass", FilterMode::LOWPASS}, {"highpass", FilterMode::HIGHPASS}, {"bandpass", FilterMode::BANDPASS}
+            };
+            int in, cutoff;
+            if (args.size() != 4) {
+                return fail("filter takes a mode, a signal, a cutoff and a Q");
+            }
+            auto mode = modes.find(args[0]);
+            if (mode == modes.end()) {
+                return fail("unknown filter '" + args[0] + "'");
+            }
+            if (filters == MAX_PATCH_FILTERS) {
+                return fail("more than " + std::to_string(MAX_PATCH_FILTERS) + " filters");
+            }
+            if (!operand(args[1], in) || !operand(args[2], cutoff) || !number(args[3], op.value)) {
+                return false;
+            }
+            if (op.value <= 0.0f) {
+                return fail("Q must be above 0");
+            }
+            op.code = PatchOpCode::FILTER;
+            op.mode = mode->second;
+            op.a = (uint8_t)in;
+            op.b = (uint8_t)cutoff;
+            op.filter = (uint8_t)filters++;
+        }
+        else {
+            return fail("unknown operation '" + code + "'");
+        }
+        int target;
+        if (!newRegister(target)) {
+            return false;
+        }
+        op.target = (uint8_t)target;
+        names[tokens[0]] = target;
+        return addOp(op);
+    }
+    
+    bool statement(const std::vector<std::string> &tokens)
+    {
+        if (tokens.size() >= 2 && tokens[1] == "=") {
+            return assignment(tokens);
+        }
+        if (tokens[0] == "out")
+        {
+            if (tokens.size() != 2) {
+                return fail("out takes one signal");
+            }
+            return operand(tokens[1], output);
+        }
+        if (tokens[0] == "table_format") {
+            return format(tokens);
+        }
+        return parameter(tokens);
+    }
+};
+
+bool compilePatch(const char *source, PatchInstrument &patch, char *error, size_t error_size)
+{
+    PatchCompiler compiler;
+    compiler.settings = makePreset("", InstrumentId::COUNT, compiler.compiled);
+    std::istringstream lines(source);
+    std::string line;
+    for (int line_nr = 1; std::getline(lines, line); ++line_nr)
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        std::vector<std::string> tokens;
+        for (std::string word; words >> word; ) {
+            tokens.push_back(word);
+        }
+        if (!tokens.empty() && !compiler.statement(tokens))
+        {
+            snprintf(error, error_size, "line %d: %s", line_nr, compiler.message.c_str());
+            return false;
+        }
+    }
+    if (compiler.output < 0)
+    {
+        snprintf(error, error_size, "no out statement");
+        return false;
+    }
+    applyPreset(compiler.settings, compiler.compiled);
+    std::copy(compiler.ops, compiler.ops + compiler.opCount, compiler.compiled.ops);
+    compiler.compiled.opCount = compiler.opCount;
+    compiler.compiled.output = compiler.output;
+    compiler.compiled.tableFormat = compiler.tableFormat;
+    for (int t = 0; t < compiler.tables; ++t) {
+        storeWaveTable(compiler.tableSamples[t], compiler.tableFormat, compiler.compiled.tables[t]);
+    }
+    patch = compiler.compiled;
+    return true;
+}
@@ -0,0 +1,94 @@
+#ifndef SYNTHY_PATCH_H
+#define SYNTHY_PATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "instrument.h"
+#include "oscillator.h"
+#include "tables.h"
+#include "voice_allocator.h"
+#include "wave_table.h"
+
+// Patches are instruments written in a small language instead of C++. A patch sets the instrument parameters and
+// wires oscillators, the envelope, arithmetic and filters into a signal, one statement per line:
+//
+//     # the bell, with a filter that opens with the envelope
+//     attack 0.01
+//     decay 1
+//     sustain 0
+//     release 1
+//     a = osc sine 2 0.001 5     # wave, ratio to the note frequency, FM amount and FM hertz
+//     w = table 0 0.5 0 0.25     # a wave of its own, amplitudes of the harmonics
+//     b = osc w 3
+//     c = mul b 0.5
+//     d = add a c
+//     e = env
+//     f = mul e 4000
+//     g = filter lowpass d f 0.7 # lowpass, highpass or bandpass; input, cutoff hertz, Q
+//     out g
+//
+// The parameters are volume, attack, decay, sustain, release, attack_curve, decay_curve, release_curve,
+// oversampling and drive, and the voice limits max_voices, priority and reserved_voices. Tables are generated when the patch compiles and, like the built in saw, are not band
+// limited per note; "table_format int16" or "table_format half" stores them in half the memory of floats. Operands are names assigned before or numbers. The patch is compiled to a list of
+// operations on blocks of PATCH_BLOCK samples, so the program is decoded once per block, not per sample.
+const int PATCH_BLOCK = 64;
+const int MAX_PATCH_OPS = 64;
+const int MAX_PATCH_REGISTERS = 16;
+const int MAX_PATCH_FILTERS = VOICE_STATE_FLOATS / 2;
+const int MAX_PATCH_TABLES = 2;
+const int MAX_TABLE_HARMONICS = 64;
+
+enum class PatchOpCode : uint8_t
+{
+    CONST, OSC, TABLE_OSC, ENV, MUL, ADD, FILTER
+};
+
+enum class FilterMode : uint8_t
+{
+    LOWPASS, HIGHPASS, BANDPASS
+};
+
+struct PatchOp
+{
+    PatchOpCode code;
+    uint8_t target;
+    uint8_t a; // operand registers
+    uint8_t b;
+    WaveType wave;
+    FilterMode mode;
+    uint8_t filter; // index of the filter state in the voice, or of the table
+    float value; // CONST: the value; OSC: ratio to the note frequency; FILTER: Q
+    float fmAmplitude;
+    float fmHertz;
+};
+
+class PatchInstrument : public Instrument
+{
+public:
+    PatchInstrument();
+    
+    // for Engine::setVoiceLimits(), PatchWatcher passes them on
+    VoiceLimits voiceLimits;
+    
+    // one sample without the filters, they need the blocks of renderWave()
+    float wave(float hertz, float t);
+    void renderWave(float hertz, int64_t first, double rate, int count, int keep, const float *envelope,
+                    float *voice_state, float *out);
+    
+private:
+    friend bool compilePatch(const char *source, PatchInstrument &patch, char *error, size_t error_size);
+    friend struct PatchCompiler;
+    
+    PatchOp ops[MAX_PATCH_OPS];
+    // room for float tables, the compact formats use half of it
+    alignas(16) unsigned char tables[MAX_PATCH_TABLES][(WAVE_TABLE_SIZE + 1) * sizeof(float)];
+    TableFormat tableFormat;
+    int opCount;
+    int output; // register of the sound, -1 for silence
+};
+
+// compiles source into patch, which is only changed when it succeeds. Otherwise error tells the line and the reason
+bool compilePatch(const char *source, PatchInstrument &patch, char *error, size_t error_size);
+
+#endif
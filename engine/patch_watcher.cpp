@@ -0,0 +1,152 @@
+#include "patch_watcher.h"
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+// what tells a changed file apart; editors that save to a new file and rename it change it as well
+struct FileVersion
+{
+    timespec modified = {};
+    off_t size = -1;
+    
+    bool operator!=(const FileVersion &other) const
+    {
+        return modified.tv_sec != other.modified.tv_sec || modified.tv_nsec != other.modified.tv_nsec
+            || size != other.size;
+    }
+};
+
+static FileVersion fileVersion(const std::string &path)
+{
+    FileVersion version;
+    struct stat info;
+    if (stat(path.c_str(), &info) == 0)
+    {
+        version.modified = info.st_mtim;
+        version.size = info.st_size;
+    }
+    return version;
+}
+
+PatchWatcher::PatchWatcher()
+{
+    for (std::atomic<int> &state : states) {
+        state.store(FREE);
+    }
+}
+
+PatchWatcher::~PatchWatcher()
+{
+    stop();
+}
+
+bool PatchWatcher::start(const char *file)
+{
+    stop();
+    path = file;
+    quit = false;
+    int slot = freeSlot();
+    bool built = slot >= 0 && build(slot);
+    thread = std::thread(&PatchWatcher::watch, this);
+    return built;
+}
+
+void PatchWatcher::stop()
+{
+    if (!thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_one();
+    thread.join();
+}
+
+int PatchWatcher::freeSlot() const
+{
+    for (int i = 0; i < PATCH_SLOTS; ++i) {
+        if (states[i].load(std::memory_order_acquire) == FREE) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool PatchWatcher::build(int slot)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+    {
+        printf("Failed to open patch %s\n", path.c_str());
+        return false;
+    }
+    std::string source;
+    char chunk[4096];
+    for (size_t read; (read = fread(chunk, 1, sizeof(chunk), file)) > 0; ) {
+        source.append(chunk, read);
+    }
+    fclose(file);
+    char error[256];
+    if (!compilePatch(source.c_str(), slots[slot], error, sizeof(error)))
+    {
+        printf("%s: %s\n", path.c_str(), error);
+        return false;
+    }
+    states[slot].store(READY, std::memory_order_release);
+    return true;
+}
+
+void PatchWatcher::watch()
+{
+    FileVersion seen = fileVersion(path);
+    bool changed = false; // and not built yet
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!wake.wait_for(lock, std::chrono::milliseconds(PATCH_POLL_MS), [this]{ return quit; }))
+    {
+        FileVersion current = fileVersion(path);
+        if (current != seen)
+        {
+            seen = current;
+            changed = true;
+        }
+        bool waiting = false;
+        for (const std::atomic<int> &state : states) {
+            waiting |= state.load(std::memory_order_acquire) == READY;
+        }
+        // the last build is not playing yet, or old notes still hold every slot: tried again at the next poll
+        int slot = freeSlot();
+        if (!changed || current.size < 0 || waiting || slot < 0) {
+            continue;
+        }
+        changed = false;
+        lock.unlock();
+        if (build(slot)) {
+            printf("Patch %s reloaded\n", path.c_str());
+        }
+        lock.lock();
+    }
+}
+
+void PatchWatcher::update(Engine &engine)
+{
+    for (int i = 0; i < PATCH_SLOTS; ++i)
+    {
+        int state = states[i].load(std::memory_order_acquire);
+        if (state == READY)
+        {
+            // before the patch can play, a full group table leaves it unlimited
+            engine.setVoiceLimits(&slots[i], slots[i].voiceLimits);
+            engine.selectPatch(&slots[i]);
+            if (playing >= 0) {
+                states[playing].store(RETIRED, std::memory_order_release);
+            }
+            states[i].store(PLAYING, std::memory_order_release);
+            playing = i;
+        }
+        else if (state == RETIRED && !engine.isPlaying(&slots[i])) {
+            states[i].store(FREE, std::memory_order_release);
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef SYNTHY_PATCH_WATCHER_H
+#define SYNTHY_PATCH_WATCHER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "engine.h"
+#include "patch.h"
+
+// compiled patches kept at once: the playing one, a new build and the old ones notes still sound with
+const int PATCH_SLOTS = 4;
+const int PATCH_POLL_MS = 250;
+
+// watches a patch file and recompiles it on a background thread whenever it changes, tables included, so editing a
+// sound never stops the audio. update() hands a finished build to the engine; notes already sounding finish with the
+// patch they started with, whose slot is only reused when none is left
+class PatchWatcher
+{
+public:
+    PatchWatcher();
+    ~PatchWatcher();
+    
+    PatchWatcher(const PatchWatcher&) = delete;
+    PatchWatcher &operator=(const PatchWatcher&) = delete;
+    
+    // compiles path once on the calling thread and starts watching it, returns false when that first build failed.
+    // Either way the file is watched, a fixed patch is picked up
+    bool start(const char *path);
+    void stop();
+    
+    // selects the newest build in engine, with its voice limits, and frees the slots of old ones no note plays anymore. Call it where notes
+    // are started, it must not run concurrently with render()
+    void update(Engine &engine);
+    
+private:
+    enum SlotState
+    {
+        FREE, READY, PLAYING, RETIRED
+    };
+    
+    void watch();
+    int freeSlot() const;
+    // compiles the file into slot, false when the patch has errors
+    bool build(int slot);
+    
+    PatchInstrument slots[PATCH_SLOTS];
+    std::atomic<int> states[PATCH_SLOTS];
+    int playing = -1; // only used by update()
+    std::string path;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool quit = false;
+};
+
+#endif
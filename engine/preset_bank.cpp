@@ -0,0 +1,153 @@
+#include "preset_bank.h"
+
+#include <algorithm>
+#include <string>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "tables.h"
+
+const size_t PRESETS_OFFSET = PAGE_SIZE;
+
+Preset makePreset(const char *name, InstrumentId voice, const Instrument &instrument)
+{
+    Preset preset = {};
+    strncpy(preset.name, name, PRESET_NAME_SIZE - 1);
+    preset.voice = (uint32_t)voice;
+    preset.oversampling = instrument.oversampling;
+    preset.volume = instrument.volume;
+    preset.drive = instrument.drive;
+    preset.startAmplitude = instrument.envelope.startAmplitude;
+    preset.attackTime = instrument.envelope.attackTime;
+    preset.decayTime = instrument.envelope.decayTime;
+    preset.sustainAmplitude = instrument.envelope.sustainAmplitude;
+    preset.releaseTime = instrument.envelope.releaseTime;
+    preset.attackCurve = instrument.envelope.attackCurve;
+    preset.decayCurve = instrument.envelope.decayCurve;
+    preset.releaseCurve = instrument.envelope.releaseCurve;
+    return preset;
+}
+
+// clamped like Engine::setParam(), a bank is outside data
+void applyPreset(const Preset &preset, Instrument &instrument)
+{
+    instrument.oversampling = oversamplingFactor(preset.oversampling);
+    instrument.volume = std::max(0.0f, preset.volume);
+    instrument.drive = std::max(0.0f, preset.drive);
+    instrument.envelope.startAmplitude = std::max(0.0f, std::min(1.0f, preset.startAmplitude));
+    instrument.envelope.attackTime = std::max(MIN_SEGMENT_TIME, preset.attackTime);
+    instrument.envelope.decayTime = std::max(MIN_SEGMENT_TIME, preset.decayTime);
+    instrument.envelope.sustainAmplitude = std::max(0.0f, std::min(1.0f, preset.sustainAmplitude));
+    instrument.envelope.releaseTime = std::max(MIN_SEGMENT_TIME, preset.releaseTime);
+    instrument.envelope.attackCurve = std::max(-MAX_ENVELOPE_CURVE, std::min(MAX_ENVELOPE_CURVE, preset.attackCurve));
+    instrument.envelope.decayCurve = std::max(-MAX_ENVELOPE_CURVE, std::min(MAX_ENVELOPE_CURVE, preset.decayCurve));
+    instrument.envelope.releaseCurve = std::max(-MAX_ENVELOPE_CURVE, std::min(MAX_ENVELOPE_CURVE, preset.releaseCurve));
+}
+
+PresetBank::~PresetBank()
+{
+    close();
+}
+
+bool PresetBank::open(const char *path)
+{
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < PRESETS_OFFSET) {
+        ::close(fd);
+        return false;
+    }
+    size_t file_bytes = (size_t)info.st_size;
+    void *mapped = mmap(nullptr, file_bytes, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    const PresetBankHeader *header = (const PresetBankHeader*)mapped;
+    const Preset *first = (const Preset*)((const char*)mapped + PRESETS_OFFSET);
+    size_t presets_bytes = (size_t)header->count * sizeof(Preset);
+    if (header->magic != PRESET_BANK_MAGIC || header->version != PRESET_BANK_VERSION
+        || header->presetBytes != sizeof(Preset) || PRESETS_OFFSET + presets_bytes != file_bytes
+        || header->checksum != fileChecksum(first, presets_bytes)) {
+        munmap(mapped, file_bytes);
+        return false;
+    }
+    memory = mapped;
+    bytes = file_bytes;
+    presets = first;
+    count = (int)header->count;
+    return true;
+}
+
+void PresetBank::close()
+{
+    if (memory) {
+        munmap(memory, bytes);
+    }
+    memory = nullptr;
+    bytes = 0;
+    presets = nullptr;
+    count = 0;
+}
+
+int PresetBank::find(const char *name) const
+{
+    for (int i = 0; i < count; ++i) {
+        if (strncmp(presets[i].name, name, PRESET_NAME_SIZE) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool PresetBank::write(const char *path, const Preset *presets, int count)
+{
+    std::string temp = std::string(path) + "." + std::to_string(getpid());
+    FILE *file = fopen(temp.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    char page[PRESETS_OFFSET] = {};
+    PresetBankHeader header = {PRESET_BANK_MAGIC, PRESET_BANK_VERSION, (uint32_t)count, (uint32_t)sizeof(Preset),
+                               fileChecksum(presets, count * sizeof(Preset))};
+    memcpy(page, &header, sizeof(header));
+    bool ok = fwrite(page, sizeof(page), 1, file) == 1
+              && (count == 0 || fwrite(presets, sizeof(Preset), count, file) == (size_t)count);
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(temp.c_str(), path) != 0) {
+        unlink(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+size_t PatchSet::arenaSize(int count)
+{
+    size_t largest = std::max(sizeof(Bell), std::max(sizeof(Harmonica), sizeof(PureSaw)));
+    return count * (sizeof(Instrument*) + largest + CACHE_LINE) + PAGE_SIZE;
+}
+
+PatchSet::PatchSet(const PresetBank &bank)
+    : arena(arenaSize(bank.size()))
+{
+    count = bank.size();
+    patches = arena.allocateArray<Instrument*>(count);
+    for (int i = 0; i < count; ++i)
+    {
+        const Preset &preset = bank.get(i);
+        patches[i] = createInstrument(arena, (InstrumentId)preset.voice);
+        if (patches[i]) {
+            applyPreset(preset, *patches[i]);
+        }
+    }
+}
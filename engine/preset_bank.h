@@ -0,0 +1,114 @@
+#ifndef SYNTHY_PRESET_BANK_H
+#define SYNTHY_PRESET_BANK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "engine.h"
+
+// A bank of patches in one binary file: a header page followed by an array of fixed size presets, little endian,
+// read in place through mmap. Any change to Preset must bump PRESET_BANK_VERSION
+const uint32_t PRESET_BANK_MAGIC = 0x53595042; // "SYPB"
+const uint32_t PRESET_BANK_VERSION = 1;
+const int PRESET_NAME_SIZE = 32;
+
+struct PresetBankHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t presetBytes; // sizeof(Preset) of the writer
+    uint32_t checksum; // FNV-1a of the presets
+};
+
+// everything a patch sets on its instrument
+struct Preset
+{
+    char name[PRESET_NAME_SIZE]; // zero terminated
+    uint32_t voice; // the InstrumentId that makes the sound
+    int32_t oversampling;
+    float volume;
+    float drive;
+    float startAmplitude;
+    float attackTime;
+    float decayTime;
+    float sustainAmplitude;
+    float releaseTime;
+    float attackCurve;
+    float decayCurve;
+    float releaseCurve;
+    uint32_t reserved[4];
+};
+
+static_assert(sizeof(Preset) == 96, "the preset layout is part of the file format");
+
+// the settings of instrument as a preset, and back
+Preset makePreset(const char *name, InstrumentId voice, const Instrument &instrument);
+void applyPreset(const Preset &preset, Instrument &instrument);
+
+class PresetBank
+{
+public:
+    PresetBank() = default;
+    ~PresetBank();
+    
+    PresetBank(const PresetBank&) = delete;
+    PresetBank& operator=(const PresetBank&) = delete;
+    
+    // maps the bank at path, false when it is missing, outdated or corrupt
+    bool open(const char *path);
+    void close();
+    
+    int size() const
+    {
+        return count;
+    }
+    
+    const Preset &get(int index) const
+    {
+        return presets[index];
+    }
+    
+    // the index of the preset called name, -1 when there is none
+    int find(const char *name) const;
+    
+    // writes a temporary file and renames it, readers never map a half written bank
+    static bool write(const char *path, const Preset *presets, int count);
+    
+private:
+    void *memory = nullptr;
+    size_t bytes = 0;
+    const Preset *presets = nullptr;
+    int count = 0;
+};
+
+// a playable instrument for every preset of a bank, made at once; notes point to them, so the set must outlive them
+class PatchSet
+{
+public:
+    explicit PatchSet(const PresetBank &bank);
+    
+    PatchSet(const PatchSet&) = delete;
+    PatchSet& operator=(const PatchSet&) = delete;
+    
+    int size() const
+    {
+        return count;
+    }
+    
+    // nullptr for presets of an unknown voice
+    Instrument *get(int index) const
+    {
+        return patches[index];
+    }
+    
+private:
+    static size_t arenaSize(int count);
+    
+    Arena arena;
+    Instrument **patches;
+    int count;
+};
+
+#endif
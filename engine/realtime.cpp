@@ -0,0 +1,142 @@
+#include "realtime.h"
+
+#include <atomic>
+#include <new>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef SYNTHY_RT_CHECK
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <unistd.h>
+#endif
+
+thread_local bool in_audio_render = false;
+thread_local int audio_render_exemptions = 0;
+
+bool inCheckedAudioRender()
+{
+    return in_audio_render && audio_render_exemptions == 0;
+}
+
+#ifdef SYNTHY_TRAP_AUDIO_ALLOC
+void *trapAudioAlloc(size_t size)
+{
+    if (inCheckedAudioRender()) {
+        in_audio_render = false; // let the report itself allocate
+        fprintf(stderr, "heap allocation of %zu bytes on the audio thread\n", size);
+        abort();
+    }
+    void *ptr = malloc(size ? size : 1);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+void *operator new(size_t size) { return trapAudioAlloc(size); }
+void *operator new[](size_t size) { return trapAudioAlloc(size); }
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete[](void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { free(ptr); }
+#endif
+
+#ifdef SYNTHY_RT_CHECK
+const int RT_CHECK_MAX_REPORTS = 10; // backtraces printed, later violations are only counted
+static std::atomic<int> rt_violations{0};
+static thread_local bool rt_reporting = false;
+
+typedef int (*MutexFunction)(pthread_mutex_t*);
+typedef long (*SyscallFunction)(long, long, long, long, long, long, long);
+typedef ssize_t (*ReadWriteFunction)(int, void*, size_t);
+typedef int (*NanosleepFunction)(const struct timespec*, struct timespec*);
+typedef int (*UsleepFunction)(useconds_t);
+typedef int (*YieldFunction)(void);
+static MutexFunction real_mutex_lock = nullptr;
+static SyscallFunction real_syscall = nullptr;
+static ReadWriteFunction real_read = nullptr, real_write = nullptr;
+static NanosleepFunction real_nanosleep = nullptr;
+static UsleepFunction real_usleep = nullptr;
+static YieldFunction real_sched_yield = nullptr;
+
+// dlsym itself allocates, so everything is resolved up front
+void initRealtimeCheck()
+{
+    real_mutex_lock = (MutexFunction)dlsym(RTLD_NEXT, "pthread_mutex_lock");
+    real_syscall = (SyscallFunction)dlsym(RTLD_NEXT, "syscall");
+    real_read = (ReadWriteFunction)dlsym(RTLD_NEXT, "read");
+    real_write = (ReadWriteFunction)dlsym(RTLD_NEXT, "write");
+    real_nanosleep = (NanosleepFunction)dlsym(RTLD_NEXT, "nanosleep");
+    real_usleep = (UsleepFunction)dlsym(RTLD_NEXT, "usleep");
+    real_sched_yield = (YieldFunction)dlsym(RTLD_NEXT, "sched_yield");
+    // the first backtrace() loads libgcc, do it now rather than inside a report
+    void *frame;
+    backtrace(&frame, 1);
+}
+
+void reportRealtimeViolation(const char *what)
+{
+    if (!inCheckedAudioRender() || rt_reporting) {
+        return;
+    }
+    rt_reporting = true;
+    int count = ++rt_violations;
+    if (count <= RT_CHECK_MAX_REPORTS) {
+        char line[128];
+        int length = snprintf(line, sizeof(line), "real-time violation #%d: %s on the audio thread\n", count, what);
+        real_write(2, line, length);
+        void *frames[32];
+        backtrace_symbols_fd(frames, backtrace(frames, 32), 2);
+    }
+    rt_reporting = false;
+}
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(size_t size) { reportRealtimeViolation("malloc"); return __libc_malloc(size); }
+void *calloc(size_t count, size_t size) { reportRealtimeViolation("calloc"); return __libc_calloc(count, size); }
+void *realloc(void *ptr, size_t size) { reportRealtimeViolation("realloc"); return __libc_realloc(ptr, size); }
+void free(void *ptr) { if (ptr) reportRealtimeViolation("free"); __libc_free(ptr); }
+
+int pthread_mutex_lock(pthread_mutex_t *mutex) { reportRealtimeViolation("pthread_mutex_lock"); return real_mutex_lock(mutex); }
+ssize_t read(int fd, void *buffer, size_t size) { reportRealtimeViolation("read"); return real_read(fd, buffer, size); }
+ssize_t write(int fd, const void *buffer, size_t size) { reportRealtimeViolation("write"); return real_write(fd, (void*)buffer, size); }
+int nanosleep(const struct timespec *duration, struct timespec *remaining) { reportRealtimeViolation("nanosleep"); return real_nanosleep(duration, remaining); }
+int usleep(useconds_t usec) { reportRealtimeViolation("usleep"); return real_usleep(usec); }
+int sched_yield(void) noexcept { reportRealtimeViolation("sched_yield"); return real_sched_yield(); }
+long syscall(long number, ...) noexcept
+{
+    va_list args;
+    va_start(args, number);
+    long a = va_arg(args, long), b = va_arg(args, long), c = va_arg(args, long);
+    long d = va_arg(args, long), e = va_arg(args, long), f = va_arg(args, long);
+    va_end(args);
+    reportRealtimeViolation("syscall");
+    return real_syscall(number, a, b, c, d, e, f);
+}
+}
+
+int realtimeViolations()
+{
+    return rt_violations.load();
+}
+#else
+void initRealtimeCheck() {}
+int realtimeViolations() { return 0; }
+#endif
+
+bool checkRealtimeViolations()
+{
+    int violations = realtimeViolations();
+    if (violations > 0) {
+        fprintf(stderr, "%d real-time violations on the audio thread\n", violations);
+    }
+    return violations == 0;
+}
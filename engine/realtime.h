@@ -0,0 +1,62 @@
+#ifndef SYNTHY_REALTIME_H
+#define SYNTHY_REALTIME_H
+
+#include <atomic>
+
+// Debug builds can define SYNTHY_TRAP_AUDIO_ALLOC to abort on any heap allocation made while rendering audio,
+// or SYNTHY_RT_CHECK (Linux, glibc) to report every allocation, lock and syscall made while rendering audio
+extern thread_local bool in_audio_render;
+extern thread_local int audio_render_exemptions;
+
+// marks the current thread as rendering audio for the lifetime of the object
+struct AudioRenderScope
+{
+    bool previous;
+    AudioRenderScope() { previous = in_audio_render; in_audio_render = true; }
+    ~AudioRenderScope() { in_audio_render = previous; }
+};
+
+// marks a deliberate and bounded exception to the real-time rules, like waking up sleeping render workers
+struct AudioRenderExemption
+{
+    AudioRenderExemption() { audio_render_exemptions++; }
+    ~AudioRenderExemption() { audio_render_exemptions--; }
+};
+
+// spins of the audio thread on its helpers before it sleeps
+const int HELPER_SPINS = 20000;
+
+// waits on the audio thread until every helper has finished its share. The shares take about as long as the one of
+// the audio thread, so it spins; only when a helper did not get a cpu (more threads than cores) does it sleep on the
+// counter, a deliberate and bounded exemption of one futex wait instead of a yield loop
+inline void waitForHelpers(std::atomic<int> &pending)
+{
+    for (int spin = 0; spin < HELPER_SPINS; ++spin) {
+        if (pending.load(std::memory_order_acquire) == 0) {
+            return;
+        }
+    }
+    AudioRenderExemption sleep;
+    for (int left; (left = pending.load(std::memory_order_acquire)) > 0; ) {
+        pending.wait(left, std::memory_order_acquire);
+    }
+}
+
+// a helper finished its share, the last one wakes the audio thread in case it went to sleep. Call it outside of
+// AudioRenderScope, the wake is only a syscall when someone waits
+inline void finishHelping(std::atomic<int> &pending)
+{
+    if (pending.fetch_sub(1, std::memory_order_release) == 1) {
+        pending.notify_one();
+    }
+}
+
+bool inCheckedAudioRender();
+
+// resolves the hooked functions of SYNTHY_RT_CHECK builds, call it before any audio is rendered
+void initRealtimeCheck();
+int realtimeViolations();
+// benchmark and test modes fail when the audio thread broke the real-time rules
+bool checkRealtimeViolations();
+
+#endif
@@ -0,0 +1,267 @@
+#include "render_pool.h"
+
+#include <algorithm>
+
+#include "oscillator.h"
+#include "realtime.h"
+
+// voices are many, the cheaper first order is enough for them
+const int VOICE_ADAA_ORDER = 1;
+
+// count samples of a note from sample first on at the given rate, the next block starts at keep. The envelope and
+// the wave are generated for the whole run first, work holds count floats
+static void renderNote(Note *note, float *samples, float *work, int count, int keep, int64_t first, double rate,
+                       bool &alive)
+{
+    Instrument *instrument = note->instrument;
+    instrument->envelope.getAmplitudes(samples, count, first / rate, 1.0 / rate, note->timeOn, note->timeOff);
+    alive = !instrument->envelope.isFinished((first + count - 1) / rate, note->timeOn, note->timeOff);
+    instrument->renderWave(note->freq, first, rate, count, keep, samples, note->voiceState, work);
+    const float volume = instrument->volume;
+    for (int i = 0; i < count; ++i) {
+        samples[i] = volume * samples[i] * work[i];
+    }
+}
+
+// a note is a function of time, so the samples the filters and the shaper need around the block are simply rendered
+// as well, no state has to be kept per note
+static void mixProcessed(Note *note, int factor, float drive, int sample_nr, int length, float *mix, float *scratch,
+                         bool &alive)
+{
+    const int margin = factor > 1 ? oversamplingMargin(factor) : 0;
+    const int history = drive > 0.0f ? VOICE_ADAA_ORDER : 0;
+    const double rate = (double)SAMPLE_RATE * factor;
+    float *samples = scratch;
+    float *filter = scratch + VOICE_SCRATCH / 2;
+    for (int done = 0; done < length; done += VOICE_CHUNK)
+    {
+        int frames = std::min(VOICE_CHUNK, length - done);
+        int64_t first = (int64_t)(sample_nr + done) * factor - margin - history;
+        int count = frames * factor + 2 * margin + history;
+        // the filters are done with the wave before they need their scratch
+        renderNote(note, samples, filter, count, frames * factor, first, rate, alive);
+        shapeBlock(samples, count, drive, VOICE_ADAA_ORDER);
+        if (factor > 1) {
+            decimateBlock(samples, frames, factor, filter, mix + done);
+        }
+        else {
+            for (int i = 0; i < frames; ++i) {
+                mix[done + i] += samples[i];
+            }
+        }
+    }
+}
+
+#ifdef SYNTHY_FIXED_POINT
+// volume * envelope * wave of a note in Q15, added to mix at FIXED_MIX_SCALE in eight 16 bit lanes at a time.
+// Volumes above 1.0 are a Q15 gain and a left shift
+static void mixFixed(Note *note, int frames, const int16_t *envelope, const int16_t *wave, int16_t *mix)
+{
+    float volume = note->instrument->volume / (1 << FIXED_MIX_SHIFT);
+    int shift = 0;
+    for (; volume >= 1.0f && shift < 15; ++shift) {
+        volume *= 0.5f;
+    }
+    const int16_t gain = toQ15(volume);
+    const q15x8 gains = splat8(gain);
+    int i = 0;
+    for (; i + 8 <= frames; i += 8)
+    {
+        q15x8 sample = mul8(mul8(load8(envelope + i), load8(wave + i)), gains);
+        if (shift > 0) {
+            sample = saturate8(__builtin_convertvector(sample, int32x8) << shift);
+        }
+        store8(mix + i, add8(load8(mix + i), sample));
+    }
+    for (; i < frames; ++i) {
+        int16_t sample = mulQ15(mulQ15(envelope[i], wave[i]), gain);
+        mix[i] = addQ15(mix[i], saturateQ15((int32_t)sample << shift));
+    }
+}
+
+// the notes that are not oversampled or shaped and have fixed point oscillators, chunk by chunk into a 16 bit mix
+// that is added to the float one; the others are marked for the float path
+static void mixFixedNotes(Note *begin, Note *end, int sample_nr, int length, float *mix, float *scratch)
+{
+    int16_t *fixed_mix = (int16_t*)scratch;
+    int16_t *envelope = fixed_mix + VOICE_CHUNK;
+    int16_t *wave = envelope + VOICE_CHUNK;
+    for (Note *note = begin; note != end; ++note) {
+        note->fixedPoint = oversamplingFactor(note->instrument->oversampling) == 1 && note->instrument->drive <= 0.0f;
+    }
+    for (int done = 0; done < length; done += VOICE_CHUNK)
+    {
+        int frames = std::min(VOICE_CHUNK, length - done);
+        std::fill(fixed_mix, fixed_mix + frames, 0);
+        for (Note *note = begin; note != end; ++note)
+        {
+            if (!note->fixedPoint) {
+                continue;
+            }
+            Instrument *instrument = note->instrument;
+            setNoiseSeed(note->noiseState);
+            // an instrument either always or never has fixed point oscillators, so this fails in the first chunk
+            if (!instrument->renderWaveQ15(note->freq, sample_nr + done, SAMPLE_RATE, frames, wave))
+            {
+                note->fixedPoint = false;
+                continue;
+            }
+            note->noiseState = getNoiseState();
+            instrument->envelope.getAmplitudesQ15(envelope, frames, (double)(sample_nr + done) / SAMPLE_RATE,
+                                                  1.0 / SAMPLE_RATE, note->timeOn, note->timeOff);
+            note->active = !instrument->envelope.isFinished((double)(sample_nr + done + frames - 1) / SAMPLE_RATE,
+                                                            note->timeOn, note->timeOff);
+            mixFixed(note, frames, envelope, wave, fixed_mix);
+        }
+        for (int i = 0; i < frames; ++i) {
+            mix[done + i] += fixed_mix[i] * (1.0f / FIXED_MIX_SCALE);
+        }
+    }
+}
+#endif
+
+void mixNotes(Note *begin, Note *end, int sample_nr, int length, float *mix, float *scratch)
+{
+#ifdef SYNTHY_FIXED_POINT
+    mixFixedNotes(begin, end, sample_nr, length, mix, scratch);
+#endif
+    for (Note *note = begin; note != end; ++note)
+    {
+#ifdef SYNTHY_FIXED_POINT
+        if (note->fixedPoint) {
+            continue;
+        }
+#endif
+        bool alive = false;
+        setNoiseSeed(note->noiseState);
+        int factor = oversamplingFactor(note->instrument->oversampling);
+        float drive = note->instrument->drive;
+        if (factor > 1 || drive > 0.0f) {
+            mixProcessed(note, factor, drive, sample_nr, length, mix, scratch, alive);
+        }
+        else {
+            for (int done = 0; done < length; done += VOICE_CHUNK)
+            {
+                int frames = std::min(VOICE_CHUNK, length - done);
+                renderNote(note, scratch, scratch + VOICE_SCRATCH / 2, frames, frames, sample_nr + done, SAMPLE_RATE,
+                           alive);
+                for (int i = 0; i < frames; ++i) {
+                    mix[done + i] += scratch[i];
+                }
+            }
+        }
+        note->active = alive;
+        note->noiseState = getNoiseState();
+    }
+}
+
+RenderPool::RenderPool(Arena &arena, int thread_count, int max_frames)
+{
+    threadCount = std::max(1, std::min(MAX_THREADS, thread_count));
+    maxFrames = max_frames;
+    int mix_floats = (max_frames * sizeof(float) + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE / sizeof(float);
+    threads = arena.allocateArray<RenderThread>(threadCount, CACHE_LINE);
+    for (int t = 0; t < threadCount; ++t) {
+        threads[t].mix = arena.allocateArray<float>(mix_floats, PAGE_SIZE);
+        threads[t].scratch = arena.allocateArray<float>(VOICE_SCRATCH, CACHE_LINE);
+    }
+    for (int t = 1; t < threadCount; ++t) {
+        threads[t].thread = std::thread(&RenderPool::worker, this, t);
+    }
+}
+
+RenderPool::~RenderPool()
+{
+    quit.store(true);
+    generation.store(++sequence << 8, std::memory_order_release);
+    generation.notify_all();
+    for (int t = 0; t < threadCount; ++t) {
+        if (threads[t].thread.joinable()) {
+            threads[t].thread.join();
+        }
+    }
+}
+
+void RenderPool::render(NoteList &notes, int sample_nr, int length, float *buffer)
+{
+    for (int done = 0; done < length; done += maxFrames) {
+        renderBlock(notes, sample_nr + done, std::min(maxFrames, length - done), buffer + done);
+    }
+}
+
+void RenderPool::renderBlock(NoteList &notes, int sample_nr, int length, float *buffer)
+{
+    int count = (int)notes.size();
+    int chunk = (count + threadCount - 1) / threadCount;
+    chunk = (chunk + NOTES_PER_LINE - 1) / NOTES_PER_LINE * NOTES_PER_LINE;
+    Note *base = notes.data();
+    for (int t = 0; t < threadCount; ++t) {
+        threads[t].first = base + std::min(count, t * chunk);
+        threads[t].last = base + std::min(count, (t + 1) * chunk);
+    }
+    jobSampleNr = sample_nr;
+    jobLength = length;
+    
+    // wake up the workers only when there is enough work to share
+    int helpers = std::min(threadCount - 1, chunk > 0 ? (count - 1) / chunk : 0);
+    pending.store(helpers, std::memory_order_relaxed);
+    if (helpers > 0) {
+        sequence++;
+        generation.store((sequence << 8) | (unsigned)helpers, std::memory_order_release);
+        // pairs with the fence in worker(): either we see its sleepers count or it sees the new generation
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_acquire) > 0) {
+            AudioRenderExemption wakeup; // one futex wake per block, only when workers went to sleep
+            generation.notify_all();
+        }
+    }
+    renderShare(0);
+    waitForHelpers(pending);
+    
+    std::copy(threads[0].mix, threads[0].mix + length, buffer);
+    for (int t = 1; t <= helpers; ++t) {
+        const float *other = threads[t].mix;
+        for (int i = 0; i < length; ++i) {
+            buffer[i] += other[i];
+        }
+    }
+}
+
+void RenderPool::renderShare(int index)
+{
+    RenderThread &self = threads[index];
+    std::fill(self.mix, self.mix + jobLength, 0.0f);
+    mixNotes(self.first, self.last, jobSampleNr, jobLength, self.mix, self.scratch);
+}
+
+void RenderPool::worker(int index)
+{
+    unsigned seen = 0; // not the current value, the first block may be posted before this thread runs
+    while (true)
+    {
+        // spin a little before going to sleep, the next block is often close
+        unsigned now = seen;
+        for (int spin = 0; spin < 20000 && now == seen; ++spin) {
+            now = generation.load(std::memory_order_acquire);
+        }
+        if (now == seen) {
+            sleepers.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            generation.wait(seen, std::memory_order_acquire);
+            sleepers.fetch_sub(1);
+            now = generation.load(std::memory_order_acquire);
+        }
+        seen = now;
+        if (quit.load()) {
+            return;
+        }
+        if (index <= (int)(seen & 0xff))
+        {
+            {
+                AudioRenderScope scope;
+                renderShare(index);
+            }
+            finishHelping(pending);
+        }
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef SYNTHY_RENDER_POOL_H
+#define SYNTHY_RENDER_POOL_H
+
+#include <atomic>
+#include <thread>
+
+#include "arena.h"
+#include "config.h"
+#include "note.h"
+#include "oversampler.h"
+#include "waveshaper.h"
+
+// oversampled or shaped notes are rendered this many output frames at a time
+const int VOICE_CHUNK = 256;
+// floats of scratch mixNotes() needs for them
+const int VOICE_SCRATCH = 2 * (MAX_OVERSAMPLING * VOICE_CHUNK + 2 * HALF_BAND_LENGTH * (MAX_OVERSAMPLING - 1) + MAX_ADAA_ORDER);
+
+// mixes a range of notes into a float buffer, one note at a time
+void mixNotes(Note *begin, Note *end, int sample_nr, int length, float *mix, float *scratch);
+
+// state owned by one render thread; each one starts on its own cache line so threads never write to a shared line
+struct alignas(CACHE_LINE) RenderThread
+{
+    float *mix = nullptr; // page aligned, so mix buffers of different threads never share a page
+    float *scratch = nullptr; // VOICE_SCRATCH floats for oversampled or shaped notes
+    Note *first = nullptr;
+    Note *last = nullptr;
+    std::thread thread;
+};
+
+// splits the notes of every block over a fixed set of threads, the calling (audio) thread renders the first share
+class RenderPool
+{
+public:
+    RenderPool(Arena &arena, int thread_count, int max_frames);
+    ~RenderPool();
+    
+    int getThreadCount() const
+    {
+        return threadCount;
+    }
+    
+    // writes the mix of all notes into buffer
+    void render(NoteList &notes, int sample_nr, int length, float *buffer);
+    
+private:
+    // the number of helpers is packed into the low bits of the generation counter
+    static constexpr int MAX_THREADS = 256;
+    // keeps notes rendered by different threads on different cache lines
+    static constexpr int NOTES_PER_LINE = CACHE_LINE / sizeof(Note) > 0 ? CACHE_LINE / sizeof(Note) : 1;
+    
+    void renderBlock(NoteList &notes, int sample_nr, int length, float *buffer);
+    void renderShare(int index);
+    void worker(int index);
+    
+    RenderThread *threads; // owned by the arena
+    int threadCount;
+    int maxFrames;
+    
+    // job description, written by the audio thread before generation is bumped
+    int jobSampleNr = 0;
+    int jobLength = 0;
+    unsigned sequence = 0;
+    
+    // synchronisation counters live on their own lines, away from the job data the workers only read
+    alignas(CACHE_LINE) std::atomic<unsigned> generation{0};
+    alignas(CACHE_LINE) std::atomic<int> pending{0};
+    alignas(CACHE_LINE) std::atomic<int> sleepers{0};
+    std::atomic<bool> quit{false};
+};
+
+#endif
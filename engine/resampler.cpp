@@ -0,0 +1,109 @@
+#include "resampler.h"
+
+#include <algorithm>
+
+#include <math.h>
+#include <string.h>
+
+#include "config.h"
+#include "simd.h"
+
+// Kaiser window, about 90 dB of stopband attenuation
+const double KAISER_BETA = 9.0;
+// cutoff as a fraction of the lower Nyquist frequency, the transition band ends just below it
+const double CUTOFF = 0.91;
+
+static_assert(RESAMPLER_TAPS % 4 == 0, "filter rows are processed four taps at a time");
+
+static double besselI0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+static float dot(const float *a, const float *b)
+{
+    float4 sum = splat4(0.0f);
+    for (int t = 0; t < RESAMPLER_TAPS; t += 4) {
+        sum += load4(a + t) * load4(b + t);
+    }
+    return sum[0] + sum[1] + sum[2] + sum[3];
+}
+
+Resampler::Resampler(int in_rate, int out_rate, int max_frames)
+    : arena((size_t)(RESAMPLER_PHASES + 1) * RESAMPLER_TAPS * sizeof(float)
+            + ((size_t)max_frames * std::max(1, (in_rate + out_rate - 1) / out_rate) + 2 * RESAMPLER_TAPS) * sizeof(float)
+            + 2 * PAGE_SIZE)
+{
+    inRate = in_rate;
+    outRate = out_rate;
+    // one pull() consumes up to max_frames * inRate / outRate inputs, more when the last ones were not pushed yet
+    capacity = max_frames * std::max(1, (in_rate + out_rate - 1) / out_rate) + 2 * RESAMPLER_TAPS;
+    buffer = arena.allocateArray<float>(capacity, CACHE_LINE);
+    filter = arena.allocateArray<float>((RESAMPLER_PHASES + 1) * RESAMPLER_TAPS, CACHE_LINE);
+    // silence before the first input, so the first output is centered on it
+    buffered = RESAMPLER_TAPS / 2 - 1;
+    
+    // row r interpolates at r / RESAMPLER_PHASES past the middle of its taps; downsampling lowers the cutoff
+    double cutoff = 0.5 * CUTOFF * std::min(1.0, (double)out_rate / in_rate);
+    const double half = RESAMPLER_TAPS / 2.0;
+    for (int r = 0; r <= RESAMPLER_PHASES; ++r)
+    {
+        double fraction = (double)r / RESAMPLER_PHASES;
+        for (int t = 0; t < RESAMPLER_TAPS; ++t)
+        {
+            double u = fraction + half - 1.0 - t;
+            double x = 2.0 * cutoff * u;
+            double sinc = fabs(x) < 1e-9 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+            double edge = u / half;
+            double window = fabs(edge) < 1.0 ? besselI0(KAISER_BETA * sqrt(1.0 - edge * edge)) / besselI0(KAISER_BETA) : 0.0;
+            filter[r * RESAMPLER_TAPS + t] = (float)(2.0 * cutoff * sinc * window);
+        }
+    }
+}
+
+int Resampler::inputNeeded(int out_frames) const
+{
+    if (out_frames <= 0) {
+        return 0;
+    }
+    int64_t last = (position + (int64_t)(out_frames - 1) * inRate) / outRate;
+    return std::max(0, (int)(last + RESAMPLER_TAPS - buffered));
+}
+
+void Resampler::push(const float *in, int frames)
+{
+    frames = std::min(frames, capacity - buffered);
+    memcpy(buffer + buffered, in, frames * sizeof(float));
+    buffered += frames;
+}
+
+void Resampler::pull(float *out, int frames)
+{
+    for (int k = 0; k < frames; ++k)
+    {
+        int64_t index = position / outRate;
+        if (index + RESAMPLER_TAPS > buffered) {
+            // not enough input, the caller skipped inputNeeded()
+            std::fill(out + k, out + frames, 0.0f);
+            break;
+        }
+        float phase = (float)(position - index * outRate) * RESAMPLER_PHASES / outRate;
+        int row = std::min((int)phase, RESAMPLER_PHASES - 1);
+        float weight = phase - row;
+        const float *x = buffer + index;
+        float a = dot(filter + row * RESAMPLER_TAPS, x);
+        float b = dot(filter + (row + 1) * RESAMPLER_TAPS, x);
+        out[k] = a + weight * (b - a);
+        position += inRate;
+    }
+    // drop the input no later output needs
+    int64_t consumed = std::min<int64_t>(position / outRate, buffered);
+    memmove(buffer, buffer + consumed, (buffered - consumed) * sizeof(float));
+    buffered -= (int)consumed;
+    position -= consumed * outRate;
+}
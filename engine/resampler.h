@@ -0,0 +1,51 @@
+#ifndef SYNTHY_RESAMPLER_H
+#define SYNTHY_RESAMPLER_H
+
+#include <stdint.h>
+
+#include "arena.h"
+
+// Converts a stream between any two sample rates with a polyphase windowed-sinc filter: RESAMPLER_PHASES sub-sample
+// positions of RESAMPLER_TAPS taps each, interpolated linearly between neighbouring phases. The read position is kept
+// as an exact fraction of the two rates, so long streams never drift. Output frame k is the input at time
+// k * in_rate / out_rate, the filter looks RESAMPLER_TAPS / 2 input frames ahead of that.
+const int RESAMPLER_TAPS = 64;
+const int RESAMPLER_PHASES = 512;
+
+class Resampler
+{
+public:
+    // max_frames bounds both the frames of one push() and of one pull()
+    Resampler(int in_rate, int out_rate, int max_frames);
+    
+    Resampler(const Resampler&) = delete;
+    Resampler &operator=(const Resampler&) = delete;
+    
+    int getInRate() const
+    {
+        return inRate;
+    }
+    
+    int getOutRate() const
+    {
+        return outRate;
+    }
+    
+    // input frames that must be pushed before out_frames can be pulled
+    int inputNeeded(int out_frames) const;
+    void push(const float *in, int frames);
+    // the input must already hold inputNeeded(frames) frames
+    void pull(float *out, int frames);
+    
+private:
+    Arena arena;
+    float *filter; // (RESAMPLER_PHASES + 1) rows of RESAMPLER_TAPS
+    float *buffer; // input not consumed yet, the oldest sample first
+    int capacity;
+    int buffered = 0;
+    int inRate;
+    int outRate;
+    int64_t position = 0; // of the next output, in 1/outRate input samples from buffer[0]
+};
+
+#endif
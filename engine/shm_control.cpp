@@ -0,0 +1,106 @@
+#include "shm_control.h"
+
+#include <new>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "shm_ring.h"
+
+const size_t CONTROL_BYTES = (sizeof(ShmControlHeader) + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+
+ShmControl::~ShmControl()
+{
+    if (header) {
+        munmap(header, CONTROL_BYTES);
+    }
+    if (owner) {
+        shm_unlink(name);
+    }
+}
+
+bool ShmControl::map(int fd)
+{
+    void *memory = mmap(nullptr, CONTROL_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+    header = (ShmControlHeader*)memory;
+    return true;
+}
+
+bool ShmControl::create(const char *control_name, Engine &engine)
+{
+    shmObjectName(control_name, name, sizeof(name));
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, CONTROL_BYTES) != 0 || !map(fd)) {
+        close(fd);
+        shm_unlink(name);
+        return false;
+    }
+    owner = true;
+    ShmControlHeader *h = new (header) ShmControlHeader();
+    h->version = SHM_CONTROL_VERSION;
+    h->slotCount = SHM_CONTROL_SLOTS;
+    for (int i = 0; i < SHM_CONTROL_SLOTS; ++i) {
+        h->slots[i].sequence.store(0);
+        h->slots[i].value.store(engine.getParam((ParamId)i));
+        seen[i] = 0;
+    }
+    // controllers check the magic last, once the slots hold the engine's values
+    std::atomic_thread_fence(std::memory_order_release);
+    h->magic = SHM_CONTROL_MAGIC;
+    return true;
+}
+
+bool ShmControl::open(const char *control_name)
+{
+    shmObjectName(control_name, name, sizeof(name));
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        return false;
+    }
+    uint32_t probe[3];
+    if (pread(fd, probe, sizeof(probe), 0) != sizeof(probe)
+        || probe[0] != SHM_CONTROL_MAGIC || probe[1] != SHM_CONTROL_VERSION || probe[2] != SHM_CONTROL_SLOTS) {
+        close(fd);
+        return false;
+    }
+    return map(fd);
+}
+
+void ShmControl::write(ParamId id, float value)
+{
+    if (id >= ParamId::COUNT) {
+        return;
+    }
+    ShmControlSlot &slot = header->slots[(int)id];
+    // nothing to take: a writer that dies between the two leaves a value the next write of the slot publishes
+    slot.value.store(value, std::memory_order_relaxed);
+    slot.sequence.fetch_add(1, std::memory_order_release);
+}
+
+float ShmControl::read(ParamId id) const
+{
+    return id < ParamId::COUNT ? header->slots[(int)id].value.load() : 0.0f;
+}
+
+void ShmControl::apply(Engine &engine)
+{
+    for (int i = 0; i < SHM_CONTROL_SLOTS; ++i)
+    {
+        ShmControlSlot &slot = header->slots[i];
+        uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence == seen[i]) {
+            continue;
+        }
+        // the value counted by sequence or a newer one, whose write changes the count again
+        engine.setParam((ParamId)i, slot.value.load(std::memory_order_relaxed));
+        seen[i] = sequence;
+    }
+}
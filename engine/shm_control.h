@@ -0,0 +1,73 @@
+#ifndef SYNTHY_SHM_CONTROL_H
+#define SYNTHY_SHM_CONTROL_H
+
+#include <atomic>
+#include <stdint.h>
+
+#include "config.h"
+#include "engine.h"
+
+// Linux only: one slot per engine parameter in POSIX shared memory. Any local process writes slots without syscalls,
+// the audio thread applies the changed ones once per block.
+const uint32_t SHM_CONTROL_MAGIC = 0x5359434e; // "SYCN"
+const uint32_t SHM_CONTROL_VERSION = 2;
+const int SHM_CONTROL_SLOTS = (int)ParamId::COUNT;
+
+// one value and a write counter: writers store the value, then count the write, so a changed count tells the audio
+// thread there is a value it has not applied. Each slot has its own cache line, so writers of different slots do
+// not slow each other down
+struct alignas(CACHE_LINE) ShmControlSlot
+{
+    std::atomic<uint32_t> sequence;
+    std::atomic<float> value;
+};
+
+struct ShmControlHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    alignas(CACHE_LINE) ShmControlSlot slots[SHM_CONTROL_SLOTS];
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<float>::is_always_lock_free,
+              "control slots are shared between processes");
+
+class ShmControl
+{
+public:
+    ShmControl() = default;
+    ~ShmControl();
+    
+    ShmControl(const ShmControl&) = delete;
+    ShmControl &operator=(const ShmControl&) = delete;
+    
+    // synth side: creates (or replaces) the named block with the current parameters of engine.
+    // The name is unlinked again when the block is destroyed
+    bool create(const char *name, Engine &engine);
+    // controller side: maps a block created by another process
+    bool open(const char *name);
+    
+    bool isOpen() const
+    {
+        return header != nullptr;
+    }
+    
+    // controller: lock free, several processes may write the same slot and the last value stored wins
+    void write(ParamId id, float value);
+    float read(ParamId id) const;
+    
+    // audio thread, before rendering a block: applies every slot written since the last call.
+    // A value stored while the slot is read is picked up by the next block
+    void apply(Engine &engine);
+    
+private:
+    bool map(int fd);
+    
+    ShmControlHeader *header = nullptr;
+    uint32_t seen[SHM_CONTROL_SLOTS] = {}; // the last applied sequence of every slot
+    char name[256] = {};
+    bool owner = false;
+};
+
+#endif
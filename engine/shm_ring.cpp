@@ -0,0 +1,156 @@
+#include "shm_ring.h"
+
+#include <algorithm>
+#include <climits>
+#include <new>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+void shmObjectName(const char *name, char *out, size_t size)
+{
+    snprintf(out, size, "%s%s", name[0] == '/' ? "" : "/", name);
+}
+
+static size_t ringBytes(uint32_t capacity)
+{
+    return PAGE_SIZE + ((size_t)capacity * sizeof(float) + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+}
+
+ShmRing::~ShmRing()
+{
+    if (header) {
+        munmap(header, mappedBytes);
+    }
+    if (owner) {
+        shm_unlink(name);
+    }
+}
+
+bool ShmRing::map(int fd, size_t bytes)
+{
+    void *memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+    header = (ShmRingHeader*)memory;
+    samples = (float*)((char*)memory + PAGE_SIZE);
+    mappedBytes = bytes;
+    return true;
+}
+
+bool ShmRing::create(const char *ring_name, int capacity_frames)
+{
+    uint32_t capacity = 1;
+    while (capacity < (uint32_t)capacity_frames) {
+        capacity <<= 1;
+    }
+    shmObjectName(ring_name, name, sizeof(name));
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    size_t bytes = ringBytes(capacity);
+    if (ftruncate(fd, bytes) != 0 || !map(fd, bytes)) {
+        close(fd);
+        shm_unlink(name);
+        return false;
+    }
+    owner = true;
+    // the whole ring is touched now, so the audio thread never takes a page fault on it
+    memset((void*)samples, 0, bytes - PAGE_SIZE);
+    ShmRingHeader *h = new (header) ShmRingHeader();
+    h->sampleRate = SAMPLE_RATE;
+    h->channels = 1;
+    h->capacity = capacity;
+    h->writePos.store(0);
+    h->claimPos.store(0);
+    h->wakeup.store(0);
+    h->waiters.store(0);
+    h->version = SHM_RING_VERSION;
+    // readers check the magic last, once everything else is in place
+    std::atomic_thread_fence(std::memory_order_release);
+    h->magic = SHM_RING_MAGIC;
+    return true;
+}
+
+bool ShmRing::open(const char *ring_name)
+{
+    shmObjectName(ring_name, name, sizeof(name));
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        return false;
+    }
+    ShmRingHeader probe;
+    if (pread(fd, &probe, sizeof(uint32_t) * 5, 0) != sizeof(uint32_t) * 5
+        || probe.magic != SHM_RING_MAGIC || probe.version != SHM_RING_VERSION) {
+        close(fd);
+        return false;
+    }
+    return map(fd, ringBytes(probe.capacity));
+}
+
+float *ShmRing::acquire(int &frames)
+{
+    uint64_t written = header->writePos.load(std::memory_order_relaxed);
+    uint32_t offset = (uint32_t)(written & (header->capacity - 1));
+    frames = std::min<int>(frames, header->capacity - offset);
+    // the claim is visible before any of the frames change, like the sequence number of a seqlock
+    header->claimPos.store(written + frames, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return samples + offset;
+}
+
+void ShmRing::commit(int frames)
+{
+    header->writePos.fetch_add(frames, std::memory_order_release);
+    header->wakeup.fetch_add(1);
+    // one syscall per block, and only while someone sleeps on the ring
+    if (header->waiters.load() > 0) {
+        syscall(SYS_futex, &header->wakeup, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    }
+}
+
+const float *ShmRing::peek(uint64_t &pos, int &frames) const
+{
+    uint64_t written = getWritePos();
+    uint64_t claimed = header->claimPos.load(std::memory_order_acquire);
+    // frames the writer claimed are being overwritten, the oldest readable frame is a ring behind the claim
+    if (claimed - pos > header->capacity) {
+        pos = claimed - header->capacity;
+    }
+    if (written <= pos) {
+        return nullptr;
+    }
+    uint32_t offset = (uint32_t)(pos & (header->capacity - 1));
+    frames = (int)std::min<uint64_t>({(uint64_t)frames, written - pos, header->capacity - offset});
+    return samples + offset;
+}
+
+bool ShmRing::lapped(uint64_t pos) const
+{
+    // orders the sample reads before the claim is loaded
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return header->claimPos.load(std::memory_order_relaxed) - pos > header->capacity;
+}
+
+bool ShmRing::wait(uint64_t pos, int timeout_ms)
+{
+    timespec timeout = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+    uint32_t seen = header->wakeup.load(std::memory_order_acquire);
+    if (getWritePos() > pos) {
+        return true;
+    }
+    header->waiters.fetch_add(1);
+    // sleeps only if no commit happened since seen was read
+    syscall(SYS_futex, &header->wakeup, FUTEX_WAIT, seen, &timeout, nullptr, 0);
+    header->waiters.fetch_sub(1);
+    return getWritePos() > pos;
+}
@@ -0,0 +1,89 @@
+#ifndef SYNTHY_SHM_RING_H
+#define SYNTHY_SHM_RING_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "config.h"
+
+// Linux only: a ring of float samples in POSIX shared memory, written by one synth and read in place by any number
+// of local processes. The writer never waits, readers that fall more than a ring behind lose the oldest audio.
+const uint32_t SHM_RING_MAGIC = 0x53594e52; // "SYNR"
+const uint32_t SHM_RING_VERSION = 2;
+
+// the first page of the mapping, the samples start on the next page
+struct ShmRingHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t sampleRate;
+    uint32_t channels;
+    uint32_t capacity; // frames, a power of two
+    alignas(CACHE_LINE) std::atomic<uint64_t> writePos; // frames written since the ring was created
+    std::atomic<uint64_t> claimPos; // writePos plus the frames handed out by acquire(), set before they are written
+    alignas(CACHE_LINE) std::atomic<uint32_t> wakeup; // futex word, bumped after every commit
+    std::atomic<uint32_t> waiters;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the ring position is shared between processes");
+static_assert(sizeof(ShmRingHeader) <= PAGE_SIZE, "the ring header must fit its page");
+
+// POSIX shared memory names start with a slash, it is added when name has none
+void shmObjectName(const char *name, char *out, size_t size);
+
+class ShmRing
+{
+public:
+    ShmRing() = default;
+    ~ShmRing();
+    
+    ShmRing(const ShmRing&) = delete;
+    ShmRing &operator=(const ShmRing&) = delete;
+    
+    // writer side: creates (or replaces) the named ring, capacity is rounded up to a power of two.
+    // The name is unlinked again when the ring is destroyed
+    bool create(const char *name, int capacity_frames);
+    // reader side: maps a ring created by another process
+    bool open(const char *name);
+    
+    bool isOpen() const
+    {
+        return header != nullptr;
+    }
+    
+    int getCapacity() const
+    {
+        return header->capacity;
+    }
+    
+    uint64_t getWritePos() const
+    {
+        return header->writePos.load(std::memory_order_acquire);
+    }
+    
+    // writer: the next free frames of the ring, frames is cut down to what is contiguous.
+    // Render straight into the returned pointer, then publish the frames with commit(). Readers count the acquired
+    // frames as overwritten already
+    float *acquire(int &frames);
+    void commit(int frames);
+    
+    // reader: up to frames contiguous samples starting at pos, pos is moved forward when the writer lapped it.
+    // Returns nullptr when nothing past pos was written yet
+    const float *peek(uint64_t &pos, int &frames) const;
+    // true when samples at pos may have been overwritten while they were read
+    bool lapped(uint64_t pos) const;
+    // blocks until something past pos is written, false on timeout
+    bool wait(uint64_t pos, int timeout_ms);
+    
+private:
+    bool map(int fd, size_t bytes);
+    
+    ShmRingHeader *header = nullptr;
+    float *samples = nullptr;
+    size_t mappedBytes = 0;
+    char name[256] = {};
+    bool owner = false;
+};
+
+#endif
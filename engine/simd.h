@@ -0,0 +1,39 @@
+#ifndef SYNTHY_SIMD_H
+#define SYNTHY_SIMD_H
+
+#include <string.h>
+
+// four floats in one register, SSE on x86 and NEON on ARM through the GCC/Clang vector extension.
+// Loads and stores do not need any alignment
+typedef float float4 __attribute__((vector_size(16)));
+typedef double double2 __attribute__((vector_size(16)));
+
+inline float4 load4(const float *p)
+{
+    float4 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline void store4(float *p, float4 v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+inline float4 splat4(float x)
+{
+    return float4{x, x, x, x};
+}
+
+inline double2 load2(const float *p)
+{
+    return double2{p[0], p[1]};
+}
+
+inline void store2(float *p, double2 v)
+{
+    p[0] = (float)v[0];
+    p[1] = (float)v[1];
+}
+
+#endif
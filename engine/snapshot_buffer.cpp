@@ -0,0 +1,41 @@
+#include "snapshot_buffer.h"
+
+#include <algorithm>
+
+SnapshotBuffer::SnapshotBuffer()
+{
+    std::fill(&buffers[0][0], &buffers[0][0] + 3 * SNAPSHOT_FRAMES, 0.0f);
+    back = 0;
+    filled = 0;
+    middle.store(1);
+    front = 2;
+    haveSnapshot = false;
+}
+
+void SnapshotBuffer::write(const float *samples, int frames)
+{
+    while (frames > 0)
+    {
+        int now = std::min(frames, SNAPSHOT_FRAMES - filled);
+        std::copy(samples, samples + now, buffers[back] + filled);
+        filled += now;
+        samples += now;
+        frames -= now;
+        if (filled == SNAPSHOT_FRAMES)
+        {
+            // the full buffer becomes the middle one, the old middle one is filled next
+            back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & ~FRESH;
+            filled = 0;
+        }
+    }
+}
+
+const float *SnapshotBuffer::read()
+{
+    if (middle.load(std::memory_order_relaxed) & FRESH)
+    {
+        front = middle.exchange(front, std::memory_order_acq_rel) & ~FRESH;
+        haveSnapshot = true;
+    }
+    return haveSnapshot ? buffers[front] : nullptr;
+}
@@ -0,0 +1,42 @@
+#ifndef SYNTHY_SNAPSHOT_BUFFER_H
+#define SYNTHY_SNAPSHOT_BUFFER_H
+
+#include <atomic>
+
+#include "config.h"
+
+// frames in one snapshot, a power of two so it can go straight into an FFT
+const int SNAPSHOT_FRAMES = 1024;
+
+// hands the latest SNAPSHOT_FRAMES of audio from the audio thread to one reader (the UI) through a triple buffer.
+// The writer only copies samples and swaps an index, it never waits; the reader always gets a whole, consistent
+// snapshot and skips the ones it was too slow for
+class SnapshotBuffer
+{
+public:
+    SnapshotBuffer();
+    
+    SnapshotBuffer(const SnapshotBuffer&) = delete;
+    SnapshotBuffer& operator=(const SnapshotBuffer&) = delete;
+    
+    // audio thread
+    void write(const float *samples, int frames);
+    // reader thread: the newest snapshot, nullptr before the first one. It stays valid until the next read()
+    const float *read();
+    
+private:
+    // the index of the middle buffer, with this bit set when the writer put a snapshot there the reader has not taken
+    static const int FRESH = 4;
+    
+    alignas(CACHE_LINE) float buffers[3][SNAPSHOT_FRAMES];
+    // writer only
+    alignas(CACHE_LINE) int back;
+    int filled;
+    // shared
+    alignas(CACHE_LINE) std::atomic<int> middle;
+    // reader only
+    alignas(CACHE_LINE) int front;
+    bool haveSnapshot;
+};
+
+#endif
@@ -0,0 +1,95 @@
+#include "synth.h"
+
+#include <algorithm>
+#include <new>
+
+#include "engine.h"
+
+struct synth
+{
+    Engine engine;
+    
+    synth(int render_threads, int max_notes) : engine(render_threads, max_notes) {}
+};
+
+synth *synth_create(int render_threads, int max_notes)
+{
+    synth *s = new (std::nothrow) synth(render_threads, max_notes > 0 ? max_notes : MAX_NOTES);
+    if (s && !s->engine.ok())
+    {
+        delete s;
+        return nullptr;
+    }
+    return s;
+}
+
+void synth_destroy(synth *s)
+{
+    delete s;
+}
+
+int synth_note_on(synth *s, int note_id, float hertz, int instrument)
+{
+    if (instrument < 0 || instrument >= (int)InstrumentId::COUNT) {
+        return -1;
+    }
+    return s->engine.noteOn(note_id, hertz, s->engine.getInstrument((InstrumentId)instrument)) ? 0 : -1;
+}
+
+void synth_note_off(synth *s, int note_id)
+{
+    s->engine.noteOff(note_id);
+}
+
+void synth_render(synth *s, float *out, int frames)
+{
+    s->engine.render(out, frames);
+}
+
+void synth_render_s16(synth *s, int16_t *out, int frames)
+{
+    s->engine.render(out, frames);
+}
+
+// returns 1 when a note on was dropped
+static int applyEvent(synth *s, const synth_event &e)
+{
+    if (e.type == SYNTH_EVENT_NOTE_ON) {
+        return synth_note_on(s, e.note_id, e.hertz, e.instrument) != 0 ? 1 : 0;
+    }
+    if (e.type == SYNTH_EVENT_NOTE_OFF) {
+        synth_note_off(s, e.note_id);
+    }
+    return 0;
+}
+
+int synth_render_events(synth *s, float *out, int frames, const synth_event *events, int event_count)
+{
+    int dropped = 0;
+    int next = 0;
+    for (int done = 0; done < frames; )
+    {
+        // render up to the next event, so every event lands on its exact frame
+        for (; next < event_count && events[next].frame <= done; ++next) {
+            dropped += applyEvent(s, events[next]);
+        }
+        int end = next < event_count ? std::min(frames, (int)events[next].frame) : frames;
+        s->engine.render(out + done, end - done);
+        done = end;
+    }
+    // events at or past the end of the block take effect from the next block on
+    for (; next < event_count; ++next) {
+        dropped += applyEvent(s, events[next]);
+    }
+    return dropped;
+}
+
+int synth_active_notes(const synth *s)
+{
+    return s->engine.getActiveNotes();
+}
+
+void synth_seed_noise(synth *s, uint32_t seed)
+{
+    s->engine.seedNoise(seed);
+}
@@ -0,0 +1,68 @@
+#ifndef SYNTHY_SYNTH_H
+#define SYNTHY_SYNTH_H
+
+/*
+ * C API of the Synthy engine, for hosts that render audio in their own process.
+ * All functions taking a synth must be called from one thread at a time, usually the host's audio thread.
+ * Output is mono at SYNTH_SAMPLE_RATE.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SYNTH_SAMPLE_RATE 44100
+
+typedef struct synth synth;
+
+enum synth_event_type
+{
+    SYNTH_EVENT_NOTE_ON = 0,
+    SYNTH_EVENT_NOTE_OFF = 1
+};
+
+/* a note event inside a rendered block, packed so arrays of it can be shared with other languages as is */
+typedef struct synth_event
+{
+    int32_t frame; /* offset from the start of the block */
+    int32_t type; /* synth_event_type */
+    int32_t note_id;
+    int32_t instrument; /* ignored for note off */
+    float hertz; /* ignored for note off */
+} synth_event;
+
+enum synth_instrument
+{
+    SYNTH_INSTRUMENT_BELL = 0,
+    SYNTH_INSTRUMENT_HARMONICA = 1,
+    SYNTH_INSTRUMENT_PURE_SAW = 2
+};
+
+/* render_threads = 1 renders on the calling thread only; returns NULL on failure */
+synth *synth_create(int render_threads, int max_notes);
+void synth_destroy(synth *s);
+
+/* note ids are chosen by the host; returns 0 on success, -1 when the instrument is unknown or all voices are busy */
+int synth_note_on(synth *s, int note_id, float hertz, int instrument);
+/* releases every sounding note with the given id */
+void synth_note_off(synth *s, int note_id);
+
+/* renders frames samples into out, full scale is 1.0 */
+void synth_render(synth *s, float *out, int frames);
+void synth_render_s16(synth *s, int16_t *out, int frames);
+/* renders frames samples and applies every event at its frame, events must be sorted by frame.
+ * Returns the number of note ons that were dropped (unknown instrument or all voices busy) */
+int synth_render_events(synth *s, float *out, int frames, const synth_event *events, int event_count);
+
+/* number of notes still sounding (including their release) */
+int synth_active_notes(const synth *s);
+/* seeds the noise of the notes started from now on, for reproducible renders */
+void synth_seed_noise(synth *s, uint32_t seed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,116 @@
+#include "synth_host.h"
+
+#include <algorithm>
+
+#include "realtime.h"
+
+static size_t hostArenaSize(int thread_count, int max_synths, int max_frames)
+{
+    size_t output_bytes = (max_frames * sizeof(float) + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+    return max_synths * (sizeof(HostedSynth) + sizeof(Engine) + CACHE_LINE + output_bytes + PAGE_SIZE)
+        + thread_count * sizeof(std::thread)
+        + 64 * 1024; // bookkeeping
+}
+
+SynthHost::SynthHost(int thread_count, int max_synths, int max_frames)
+    : arena(hostArenaSize(std::max(1, std::min(MAX_THREADS, thread_count)), std::max(1, max_synths), max_frames))
+{
+    threadCount = std::max(1, std::min(MAX_THREADS, thread_count));
+    maxSynths = std::max(1, max_synths);
+    maxFrames = max_frames;
+    synths = arena.allocateArray<HostedSynth>(maxSynths, CACHE_LINE);
+    workers = arena.allocateArray<std::thread>(threadCount);
+    // without memory the host has no helpers and addSynth() fails
+    if (!synths || !workers)
+    {
+        maxSynths = 0;
+        threadCount = 1;
+    }
+    for (int t = 1; t < threadCount; ++t) {
+        workers[t] = std::thread(&SynthHost::worker, this);
+    }
+}
+
+SynthHost::~SynthHost()
+{
+    quit.store(true);
+    generation.fetch_add(1, std::memory_order_release);
+    generation.notify_all();
+    for (int t = 1; t < threadCount; ++t) {
+        workers[t].join();
+    }
+}
+
+int SynthHost::addSynth(int max_notes)
+{
+    if (synthCount == maxSynths) {
+        return -1;
+    }
+    HostedSynth &synth = synths[synthCount];
+    synth.engine = arena.create<Engine>(1, max_notes, maxFrames);
+    synth.output = arena.allocateArray<float>(maxFrames, PAGE_SIZE);
+    if (!synth.engine || !synth.engine->ok() || !synth.output) {
+        return -1;
+    }
+    return synthCount++;
+}
+
+void SynthHost::render(int frames)
+{
+    AudioRenderScope scope;
+    if (synthCount == 0) {
+        return;
+    }
+    jobFrames = std::min(frames, maxFrames);
+    next.store(0, std::memory_order_relaxed);
+    pending.store(threadCount - 1, std::memory_order_relaxed);
+    if (threadCount > 1) {
+        generation.fetch_add(1, std::memory_order_release);
+        // a worker going to sleep fences too, so it either sees this cycle or is counted in sleepers
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_acquire) > 0) {
+            AudioRenderExemption wakeup; // one futex wake per cycle, only when workers went to sleep
+            generation.notify_all();
+        }
+    }
+    renderSynths();
+    waitForHelpers(pending);
+    // the next cycle starts one synth later
+    jobFirst = (jobFirst + 1) % synthCount;
+}
+
+void SynthHost::renderSynths()
+{
+    for (int taken = next.fetch_add(1, std::memory_order_relaxed); taken < synthCount;
+         taken = next.fetch_add(1, std::memory_order_relaxed))
+    {
+        HostedSynth &synth = synths[(jobFirst + taken) % synthCount];
+        synth.engine->render(synth.output, jobFrames);
+    }
+}
+
+void SynthHost::worker()
+{
+    unsigned seen = 0; // not the current value, the first cycle may be posted before this thread runs
+    while (true)
+    {
+        // spin a little before going to sleep, the next cycle is often close
+        unsigned now = seen;
+        for (int spin = 0; spin < 20000 && now == seen; ++spin) {
+            now = generation.load(std::memory_order_acquire);
+        }
+        if (now == seen) {
+            sleepers.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            generation.wait(seen, std::memory_order_acquire);
+            sleepers.fetch_sub(1);
+            now = generation.load(std::memory_order_acquire);
+        }
+        seen = now;
+        if (quit.load()) {
+            return;
+        }
+        renderSynths();
+        finishHelping(pending);
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef SYNTHY_SYNTH_HOST_H
+#define SYNTHY_SYNTH_HOST_H
+
+#include <atomic>
+#include <thread>
+
+#include "arena.h"
+#include "config.h"
+#include "engine.h"
+
+// one synth of a host: an engine rendering on whichever thread picks it up, and its own output
+struct alignas(CACHE_LINE) HostedSynth
+{
+    Engine *engine = nullptr;
+    float *output = nullptr; // page aligned, outputs of different synths never share a page
+};
+
+// runs many independent synths in one process on a shared set of threads. Every render() renders every synth
+// exactly once; threads take synths from a shared counter, starting at a different synth each cycle so no synth is
+// always the last one done. Engines render on a single thread each and share the read-only tables.
+class SynthHost
+{
+public:
+    SynthHost(int thread_count, int max_synths, int max_frames = 4096);
+    ~SynthHost();
+    
+    SynthHost(const SynthHost&) = delete;
+    SynthHost &operator=(const SynthHost&) = delete;
+    
+    // allocates a synth, returns its index or -1 when the host is full.
+    // Like notes, synths must not be added while render() runs
+    int addSynth(int max_notes = MAX_NOTES);
+    
+    Engine *getEngine(int index)
+    {
+        return synths[index].engine;
+    }
+    
+    // the samples of the last render(), full scale is 1.0
+    const float *getOutput(int index) const
+    {
+        return synths[index].output;
+    }
+    
+    int getSynthCount() const
+    {
+        return synthCount;
+    }
+    
+    int getThreadCount() const
+    {
+        return threadCount;
+    }
+    
+    // renders frames samples (at most max_frames) of every synth, the calling thread takes part
+    void render(int frames);
+    
+private:
+    static constexpr int MAX_THREADS = 256;
+    
+    void renderSynths();
+    void worker();
+    
+    Arena arena;
+    HostedSynth *synths; // owned by the arena
+    std::thread *workers;
+    int maxSynths;
+    int synthCount = 0;
+    int threadCount;
+    int maxFrames;
+    
+    // job description, written by the rendering thread before generation is bumped
+    int jobFrames = 0;
+    int jobFirst = 0; // the synth taken first in this cycle
+    
+    alignas(CACHE_LINE) std::atomic<unsigned> generation{0};
+    alignas(CACHE_LINE) std::atomic<int> next{0};
+    alignas(CACHE_LINE) std::atomic<int> pending{0};
+    alignas(CACHE_LINE) std::atomic<int> sleepers{0};
+    std::atomic<bool> quit{false};
+};
+
+#endif
@@ -0,0 +1,149 @@
+#include "tables.h"
+
+#include <math.h>
+#include <mutex>
+#include <new>
+#include <string>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "fixed_point.h"
+
+const size_t TABLES_OFFSET = PAGE_SIZE;
+const size_t TABLES_FILE_BYTES = TABLES_OFFSET + sizeof(Tables);
+
+static const Tables *tables = nullptr;
+static std::once_flag tables_once;
+static bool tables_cached = false; // mapped from or written to the cache file
+
+uint32_t fileChecksum(const void *data, size_t bytes)
+{
+    const uint8_t *p = (const uint8_t*)data;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < bytes; ++i) {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static void generateTables(Tables &t)
+{
+    for (int i = 0; i <= WAVE_TABLE_SIZE; ++i)
+    {
+        double phase = 2.0 * M_PI * i / WAVE_TABLE_SIZE;
+        t.sine[i] = (float)sin(phase);
+        double saw = 0.0;
+        for (int h = 1; h <= SAW_HARMONICS; ++h) {
+            saw += sin(h * phase) / h;
+        }
+        t.saw[i] = (float)(saw * 2.0 / M_PI);
+        t.sineQ15[i] = (int16_t)lrint(sin(phase) * FIXED_SCALE);
+        t.sawQ15[i] = (int16_t)lrint(saw * 2.0 / M_PI * FIXED_SCALE);
+    }
+    // windowed sinc with a cutoff at a quarter of the rate, Blackman-Harris window over the whole filter
+    const int half_length = 2 * HALF_BAND_TAPS - 1;
+    double sum = 0.0;
+    for (int j = 0; j < HALF_BAND_TAPS; ++j)
+    {
+        int n = 2 * j + 1;
+        double x = M_PI * (n + half_length + 1) / (half_length + 1);
+        double window = 0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2 * x) - 0.01168 * cos(3 * x);
+        double tap = sin(M_PI * n / 2.0) / (M_PI * n) * window;
+        t.halfBand[j] = (float)tap;
+        sum += 2.0 * tap;
+    }
+    // unity gain at DC: the center tap gives 0.5, the others the rest
+    for (int j = 0; j < HALF_BAND_TAPS; ++j) {
+        t.halfBand[j] = (float)(t.halfBand[j] * 0.5 / sum);
+    }
+}
+
+static std::string defaultCachePath()
+{
+    const char *cache = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    std::string dir = cache && cache[0] ? std::string(cache) : home ? std::string(home) + "/.cache" : std::string("/tmp");
+    mkdir(dir.c_str(), 0755);
+    return dir + "/synthy-tables-v" + std::to_string(TABLES_VERSION) + ".bin";
+}
+
+// returns the tables of a valid cache file, nullptr when there is none
+static const Tables *mapCache(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size != TABLES_FILE_BYTES) {
+        close(fd);
+        return nullptr;
+    }
+    // populated up front, the audio thread must not fault the pages in
+    void *memory = mmap(nullptr, TABLES_FILE_BYTES, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        return nullptr;
+    }
+    const TablesFileHeader *header = (const TablesFileHeader*)memory;
+    const Tables *mapped = (const Tables*)((const char*)memory + TABLES_OFFSET);
+    if (header->magic != TABLES_MAGIC || header->version != TABLES_VERSION || header->tablesBytes != sizeof(Tables)
+        || header->checksum != fileChecksum(mapped, sizeof(Tables))) {
+        munmap(memory, TABLES_FILE_BYTES);
+        return nullptr;
+    }
+    return mapped;
+}
+
+// writes a temporary file and renames it, so concurrent launches never map a half written cache
+static bool writeCache(const std::string &path, const Tables &t)
+{
+    std::string temp = path + "." + std::to_string(getpid());
+    FILE *file = fopen(temp.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    char page[TABLES_OFFSET] = {};
+    TablesFileHeader header = {TABLES_MAGIC, TABLES_VERSION, (uint32_t)sizeof(Tables), fileChecksum(&t, sizeof(Tables))};
+    memcpy(page, &header, sizeof(header));
+    bool ok = fwrite(page, sizeof(page), 1, file) == 1 && fwrite(&t, sizeof(Tables), 1, file) == 1;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(temp.c_str(), path.c_str()) != 0) {
+        unlink(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+static void loadTables(const char *path)
+{
+    std::string cache_path = path ? std::string(path) : defaultCachePath();
+    tables = mapCache(cache_path);
+    if (tables) {
+        tables_cached = true;
+        return;
+    }
+    Tables *generated = new Tables;
+    generateTables(*generated);
+    tables_cached = writeCache(cache_path, *generated);
+    // the cache is used from the next launch on, the generated copy is as good for this one
+    tables = generated;
+}
+
+bool initTables(const char *path)
+{
+    std::call_once(tables_once, loadTables, path);
+    return tables_cached;
+}
+
+const Tables &getTables()
+{
+    return *tables;
+}
@@ -0,0 +1,52 @@
+#ifndef SYNTHY_TABLES_H
+#define SYNTHY_TABLES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Precomputed tables shared by every engine of the process. They are generated once, saved into a cache file
+// and memory-mapped read-only by later launches, so all synth processes of a host share one copy in the page cache.
+// Any change to the layout or the generating code must bump TABLES_VERSION.
+const uint32_t TABLES_MAGIC = 0x53595442; // "SYTB"
+const uint32_t TABLES_VERSION = 3;
+
+// samples per cycle, a power of two; every table has one extra sample so interpolation never wraps
+const int WAVE_TABLE_BITS = 11;
+const int WAVE_TABLE_SIZE = 1 << WAVE_TABLE_BITS;
+// harmonics of the band-limited saw
+const int SAW_HARMONICS = 39;
+// non-zero taps on one side of the half-band lowpass used for oversampling, the filter has 4 * HALF_BAND_TAPS - 1 taps
+const int HALF_BAND_TAPS = 8;
+
+struct Tables
+{
+    float sine[WAVE_TABLE_SIZE + 1];
+    float saw[WAVE_TABLE_SIZE + 1];
+    // the same in Q15 at a quarter of full scale (FIXED_SCALE), for the fixed point oscillators
+    int16_t sineQ15[WAVE_TABLE_SIZE + 1];
+    int16_t sawQ15[WAVE_TABLE_SIZE + 1];
+    // taps 1, 3, 5, ... of the half-band filter, the center tap is 0.5 and the other even taps are zero
+    float halfBand[HALF_BAND_TAPS];
+};
+
+// the file starts with this header, the tables follow on the next page
+struct TablesFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t tablesBytes; // sizeof(Tables) of the writer
+    uint32_t checksum; // FNV-1a of the tables
+};
+
+// FNV-1a, the checksum of the binary files
+uint32_t fileChecksum(const void *data, size_t bytes);
+
+// maps the cache file at path, or synthy-tables-v<version>.bin in $XDG_CACHE_HOME (~/.cache) when path is nullptr.
+// A missing, outdated or corrupt file is regenerated. Only the first call does anything, later ones return at once;
+// the Engine calls it too, so most programs never need to. Returns false when the cache could not be written: the
+// tables work all the same, but the next launch generates them again. Nothing is printed, hosts decide what to report
+bool initTables(const char *path = nullptr);
+// initTables() must have run
+const Tables &getTables();
+
+#endif
@@ -0,0 +1,184 @@
+#include "voice_allocator.h"
+
+#include <algorithm>
+
+VoiceAllocator::VoiceAllocator()
+{
+    groups[0] = {nullptr, VoiceLimits(), 0, -1, -1};
+    groupCount = 1;
+    slots = nullptr;
+    spare = nullptr;
+}
+
+void VoiceAllocator::init(Arena &arena, int max_notes)
+{
+    slots = arena.allocateArray<Slot>(max_notes);
+    spare = arena.allocateArray<Slot>(max_notes);
+}
+
+int VoiceAllocator::groupOf(const Instrument *instrument) const
+{
+    for (int g = 1; g < groupCount; ++g) {
+        if (groups[g].instrument == instrument) {
+            return g;
+        }
+    }
+    return 0;
+}
+
+bool VoiceAllocator::setLimits(const Instrument *instrument, const VoiceLimits &limits)
+{
+    int g = groupOf(instrument);
+    if (g == 0)
+    {
+        if (groupCount == MAX_VOICE_GROUPS) {
+            return false;
+        }
+        // notes already sounding stay in the shared group
+        g = groupCount++;
+        groups[g] = {instrument, VoiceLimits(), 0, -1, -1};
+    }
+    groups[g].limits.maxVoices = std::max(0, limits.maxVoices);
+    groups[g].limits.priority = limits.priority;
+    groups[g].limits.reserved = std::max(0, limits.reserved);
+    return true;
+}
+
+VoiceLimits VoiceAllocator::getLimits(const Instrument *instrument) const
+{
+    return groups[groupOf(instrument)].limits;
+}
+
+bool VoiceAllocator::hasRoom(const NoteList &notes, int group) const
+{
+    int free = notes.getCapacity() - notes.size();
+    int held = 0;
+    for (int g = 1; g < groupCount; ++g) {
+        if (g != group) {
+            held += std::max(0, groups[g].limits.reserved - groups[g].voices);
+        }
+    }
+    return free > held;
+}
+
+int VoiceAllocator::victimFor(int group) const
+{
+    // the lowest priority below the one of group, and of those the group with the most voices
+    const int below = groups[group].limits.priority;
+    int victim = -1;
+    for (int g = 0; g < groupCount; ++g)
+    {
+        const Group &candidate = groups[g];
+        const int priority = candidate.limits.priority;
+        if (candidate.voices <= candidate.limits.reserved || priority >= below) {
+            continue;
+        }
+        if (victim < 0 || priority < groups[victim].limits.priority
+            || (priority == groups[victim].limits.priority && candidate.voices > groups[victim].voices)) {
+            victim = g;
+        }
+    }
+    return victim < 0 ? -1 : groups[victim].oldest;
+}
+
+void VoiceAllocator::link(int index, int group)
+{
+    Group &g = groups[group];
+    slots[index] = {g.newest, -1, group, -1};
+    if (g.newest >= 0) {
+        slots[g.newest].newer = index;
+    }
+    else {
+        g.oldest = index;
+    }
+    g.newest = index;
+    g.voices++;
+}
+
+void VoiceAllocator::unlink(int index)
+{
+    Slot &slot = slots[index];
+    Group &g = groups[slot.group];
+    if (slot.older >= 0) {
+        slots[slot.older].newer = slot.newer;
+    }
+    else {
+        g.oldest = slot.newer;
+    }
+    if (slot.newer >= 0) {
+        slots[slot.newer].older = slot.older;
+    }
+    else {
+        g.newest = slot.older;
+    }
+    g.voices--;
+}
+
+bool VoiceAllocator::start(NoteList &notes, const Note &note)
+{
+    const int group = groupOf(note.instrument);
+    const VoiceLimits &limits = groups[group].limits;
+    int index = -1;
+    if (limits.maxVoices > 0 && groups[group].voices >= limits.maxVoices) {
+        index = groups[group].oldest;
+    }
+    else if (!hasRoom(notes, group))
+    {
+        index = victimFor(group);
+        if (index < 0) {
+            return false;
+        }
+    }
+    if (index >= 0)
+    {
+        // the old note stops at once, its voice goes to the new one
+        unlink(index);
+        notes.data()[index] = note;
+    }
+    else
+    {
+        if (!notes.push(note)) {
+            return false;
+        }
+        index = notes.size() - 1;
+    }
+    link(index, group);
+    return true;
+}
+
+void VoiceAllocator::removeInactive(NoteList &notes)
+{
+    int kept = 0;
+    for (int i = 0; i < notes.size(); ++i) {
+        slots[i].moved = notes.data()[i].active ? kept++ : -1;
+    }
+    // every group is walked oldest first, so the new links keep the ages
+    for (int g = 0; g < groupCount; ++g)
+    {
+        Group &group = groups[g];
+        int newest = -1;
+        int voices = 0;
+        int oldest = -1;
+        for (int i = group.oldest; i >= 0; i = slots[i].newer)
+        {
+            int n = slots[i].moved;
+            if (n < 0) {
+                continue;
+            }
+            spare[n] = {newest, -1, g, -1};
+            if (newest >= 0) {
+                spare[newest].newer = n;
+            }
+            else {
+                oldest = n;
+            }
+            newest = n;
+            voices++;
+        }
+        group.oldest = oldest;
+        group.newest = newest;
+        group.voices = voices;
+    }
+    std::swap(slots, spare);
+    notes.removeInactive();
+}
@@ -0,0 +1,72 @@
+#ifndef SYNTHY_VOICE_ALLOCATOR_H
+#define SYNTHY_VOICE_ALLOCATOR_H
+
+#include "arena.h"
+#include "instrument.h"
+#include "note.h"
+
+// instruments with limits of their own, the first group holds every other instrument
+const int MAX_VOICE_GROUPS = 16;
+
+struct VoiceLimits
+{
+    // notes of the instrument at once, 0 is no limit; a note beyond it replaces the oldest note of the instrument
+    int maxVoices = 0;
+    // when every voice is in use, a new note replaces the oldest note of the lowest priority below its own;
+    // without one it is dropped
+    int priority = 0;
+    // voices kept for the instrument: other instruments neither start notes in them nor take its notes below it
+    int reserved = 0;
+};
+
+// decides where a new note goes in constant time. Instruments with limits form groups, every group keeps its notes
+// oldest first in links beside the note list, so the note to replace is always at the front of one of them
+class VoiceAllocator
+{
+public:
+    VoiceAllocator();
+    
+    void init(Arena &arena, int max_notes);
+    
+    // false when MAX_VOICE_GROUPS - 1 instruments have limits already
+    bool setLimits(const Instrument *instrument, const VoiceLimits &limits);
+    VoiceLimits getLimits(const Instrument *instrument) const;
+    
+    // adds note to notes, or replaces an older note with it; false when the limits drop it
+    bool start(NoteList &notes, const Note &note);
+    // notes.removeInactive() keeping the order of the groups
+    void removeInactive(NoteList &notes);
+    
+private:
+    struct Group
+    {
+        const Instrument *instrument;
+        VoiceLimits limits;
+        int voices;
+        int oldest; // note indices, -1 when there are no voices
+        int newest;
+    };
+    
+    struct Slot
+    {
+        int older;
+        int newer;
+        int group;
+        int moved; // index after removeInactive(), -1 when it goes
+    };
+    
+    int groupOf(const Instrument *instrument) const;
+    // whether group can start a note without replacing one
+    bool hasRoom(const NoteList &notes, int group) const;
+    // the note a note of group replaces when there is no room, -1 for none
+    int victimFor(int group) const;
+    void link(int index, int group);
+    void unlink(int index);
+    
+    Group groups[MAX_VOICE_GROUPS];
+    int groupCount;
+    Slot *slots; // one per note, owned by the arena
+    Slot *spare; // the links being rebuilt by removeInactive()
+};
+
+#endif
@@ -0,0 +1,184 @@
+#include "wave_table.h"
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+#include "oscillator.h"
+#include "simd.h"
+
+const float INT16_TABLE_SCALE = 32767.0f;
+
+// round to nearest even; tables stay far below the largest half float
+static uint16_t floatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+    if (exponent >= 31) {
+        return (uint16_t)(sign | 0x7c00);
+    }
+    int shift = 13;
+    uint32_t half;
+    if (exponent <= 0)
+    {
+        // subnormal: the implicit bit becomes part of the mantissa
+        if (exponent < -10) {
+            return (uint16_t)sign;
+        }
+        mantissa |= 0x800000;
+        shift = 14 - exponent;
+        half = mantissa >> shift;
+    }
+    else {
+        half = ((uint32_t)exponent << 10) | (mantissa >> shift);
+    }
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    // a carry out of the mantissa moves into the exponent, which is right
+    if (rest > halfway || (rest == halfway && (half & 1))) {
+        half++;
+    }
+    return (uint16_t)(sign | half);
+}
+
+static float halfToFloat(uint16_t half)
+{
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+    if (exponent == 0)
+    {
+        float value = ldexpf((float)mantissa, -24);
+        return sign ? -value : value;
+    }
+    uint32_t bits = sign | (exponent == 31 ? 0x7f800000 : (exponent - 15 + 127) << 23) | (mantissa << 13);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+size_t waveTableBytes(TableFormat format)
+{
+    return (WAVE_TABLE_SIZE + 1) * (format == TableFormat::FLOAT ? sizeof(float) : sizeof(uint16_t));
+}
+
+void storeWaveTable(const float *samples, TableFormat format, void *out)
+{
+    switch (format) {
+        case TableFormat::FLOAT:
+            memcpy(out, samples, waveTableBytes(format));
+            break;
+        case TableFormat::INT16:
+            for (int i = 0; i <= WAVE_TABLE_SIZE; ++i)
+            {
+                float clamped = std::max(-1.0f, std::min(1.0f, samples[i]));
+                ((int16_t*)out)[i] = (int16_t)lrintf(clamped * INT16_TABLE_SCALE);
+            }
+            break;
+        case TableFormat::HALF:
+            for (int i = 0; i <= WAVE_TABLE_SIZE; ++i) {
+                ((uint16_t*)out)[i] = floatToHalf(samples[i]);
+            }
+            break;
+    }
+}
+
+static float tableSample(const WaveTable &table, int index)
+{
+    switch (table.format) {
+        case TableFormat::FLOAT: return ((const float*)table.samples)[index];
+        case TableFormat::INT16: return ((const int16_t*)table.samples)[index] * (1.0f / INT16_TABLE_SCALE);
+        case TableFormat::HALF: return halfToFloat(((const uint16_t*)table.samples)[index]);
+    }
+    return 0.0f;
+}
+
+// the index and fraction where getWave() reads a table for the angle radians
+static void tablePosition(float radians, int &index, float &fraction)
+{
+    double cycles = radians * (1.0 / (2.0 * M_PI));
+    double position = (cycles - floor(cycles)) * WAVE_TABLE_SIZE;
+    index = (int)position;
+    fraction = (float)(position - index);
+    index &= WAVE_TABLE_SIZE - 1;
+}
+
+float getTableWave(const WaveTable &table, float t, float hertz, float fmAmplitude, float fmHertz)
+{
+    int index;
+    float fraction;
+    tablePosition(getPhase(t, hertz, fmAmplitude, fmHertz), index, fraction);
+    float a = tableSample(table, index);
+    return a + fraction * (tableSample(table, index + 1) - a);
+}
+
+// the samples at index[0..3] and the ones after them, as floats
+static void gather4(const WaveTable &table, const int *index, float4 &a, float4 &b)
+{
+    switch (table.format) {
+        case TableFormat::FLOAT:
+        {
+            const float *s = (const float*)table.samples;
+            a = float4{s[index[0]], s[index[1]], s[index[2]], s[index[3]]};
+            b = float4{s[index[0] + 1], s[index[1] + 1], s[index[2] + 1], s[index[3] + 1]};
+            break;
+        }
+        case TableFormat::INT16:
+        {
+            typedef int32_t int4 __attribute__((vector_size(16)));
+            const int16_t *s = (const int16_t*)table.samples;
+            int4 ia = {s[index[0]], s[index[1]], s[index[2]], s[index[3]]};
+            int4 ib = {s[index[0] + 1], s[index[1] + 1], s[index[2] + 1], s[index[3] + 1]};
+            a = __builtin_convertvector(ia, float4) * (1.0f / INT16_TABLE_SCALE);
+            b = __builtin_convertvector(ib, float4) * (1.0f / INT16_TABLE_SCALE);
+            break;
+        }
+        case TableFormat::HALF:
+        {
+            const uint16_t *s = (const uint16_t*)table.samples;
+#ifdef __F16C__
+            __m128i halves = _mm_setr_epi16((short)s[index[0]], (short)s[index[1]], (short)s[index[2]],
+                                            (short)s[index[3]], (short)s[index[0] + 1], (short)s[index[1] + 1],
+                                            (short)s[index[2] + 1], (short)s[index[3] + 1]);
+            a = (float4)_mm_cvtph_ps(halves);
+            b = (float4)_mm_cvtph_ps(_mm_unpackhi_epi64(halves, halves));
+#else
+            for (int k = 0; k < 4; ++k)
+            {
+                a[k] = halfToFloat(s[index[k]]);
+                b[k] = halfToFloat(s[index[k] + 1]);
+            }
+#endif
+            break;
+        }
+    }
+}
+
+void renderWaveTable(const WaveTable &table, float hertz, float fmAmplitude, float fmHertz, int64_t first,
+                     double rate, int count, float *out)
+{
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        int index[4];
+        float4 fraction;
+        for (int k = 0; k < 4; ++k)
+        {
+            float t = (float)((double)(first + i + k) / rate);
+            tablePosition(getPhase(t, hertz, fmAmplitude, fmHertz), index[k], fraction[k]);
+        }
+        float4 a = {}, b = {};
+        gather4(table, index, a, b);
+        store4(out + i, a + fraction * (b - a));
+    }
+    for (; i < count; ++i) {
+        out[i] = getTableWave(table, (float)((double)(first + i) / rate), hertz, fmAmplitude, fmHertz);
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef SYNTHY_WAVE_TABLE_H
+#define SYNTHY_WAVE_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tables.h"
+
+// how the samples of a one cycle table are stored. 16 bit integers (1.0 is 32767) and half precision floats take
+// half the memory of floats, so twice as many tables fit in the caches; they are converted back as they are read
+enum class TableFormat : uint8_t
+{
+    FLOAT, INT16, HALF
+};
+
+// one cycle of WAVE_TABLE_SIZE + 1 samples in any format
+struct WaveTable
+{
+    const void *samples;
+    TableFormat format;
+};
+
+// bytes of one table in format
+size_t waveTableBytes(TableFormat format);
+// converts WAVE_TABLE_SIZE + 1 float samples into out, 16 bit tables clamp to -1..1
+void storeWaveTable(const float *samples, TableFormat format, void *out);
+
+// one sample of the table like getWave(), at time t
+float getTableWave(const WaveTable &table, float t, float hertz, float fmAmplitude = 0, float fmHertz = 0);
+// count samples of getTableWave() at the times first / rate, (first + 1) / rate, ... Four samples are interpolated
+// at a time, converted to floats as they are gathered (with F16C for half floats when the compiler targets it)
+void renderWaveTable(const WaveTable &table, float hertz, float fmAmplitude, float fmHertz, int64_t first,
+                     double rate, int count, float *out);
+
+#endif
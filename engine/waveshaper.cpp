@@ -0,0 +1,129 @@
+#include "waveshaper.h"
+
+#include <algorithm>
+
+#include "simd.h"
+
+// the curve works on u = drive * x / 1.5: f(u) = u - u^3/3 clipped at +-2/3, F1 and F2 are its first and second
+// antiderivatives. Written once for scalars and vectors, where comparisons and ?: work per lane
+template <typename T, typename S>
+static T shape(T u)
+{
+    T a = u < S(0) ? -u : u;
+    T sign = u < S(0) ? T{} - S(1) : T{} + S(1);
+    return a < S(1) ? u - u * u * u / S(3) : sign * (S(2) / S(3));
+}
+
+template <typename T, typename S>
+static T antiderivative1(T u)
+{
+    T a = u < S(0) ? -u : u;
+    T u2 = u * u;
+    return a < S(1) ? u2 / S(2) - u2 * u2 / S(12) : a * (S(2) / S(3)) - S(1) / S(4);
+}
+
+template <typename T, typename S>
+static T antiderivative2(T u)
+{
+    T a = u < S(0) ? -u : u;
+    T sign = u < S(0) ? T{} - S(1) : T{} + S(1);
+    T u3 = u * u * u;
+    return a < S(1) ? u3 / S(6) - u3 * u * u / S(60) : sign * (u * u / S(3) - a / S(4) + S(1) / S(15));
+}
+
+// (F(u0) - F(u1)) / (u0 - u1), or the derivative of F at the midpoint when the inputs are too close for the division
+template <typename T, typename S, T (*F)(T), T (*DERIVATIVE)(T)>
+static T dividedDifference(T u0, T u1, S epsilon)
+{
+    T diff = u0 - u1;
+    auto close = (diff < epsilon) & (diff > -epsilon);
+    T ratio = (F(u0) - F(u1)) / (close ? T{} + S(1) : diff);
+    return close ? DERIVATIVE((u0 + u1) / S(2)) : ratio;
+}
+
+template <typename T, typename S>
+static T adaa1(T u0, T u1)
+{
+    return dividedDifference<T, S, antiderivative1<T, S>, shape<T, S>>(u0, u1, S(1e-4));
+}
+
+template <typename T, typename S>
+static T adaa2(T u0, T u1, T u2)
+{
+    const S epsilon = S(1e-5);
+    T d01 = dividedDifference<T, S, antiderivative2<T, S>, antiderivative1<T, S>>(u0, u1, epsilon);
+    T d12 = dividedDifference<T, S, antiderivative2<T, S>, antiderivative1<T, S>>(u1, u2, epsilon);
+    T span = u0 - u2;
+    auto close = (span < epsilon) & (span > -epsilon);
+    T regular = S(2) * (d01 - d12) / (close ? T{} + S(1) : span);
+    // u0 == u2: the limit around the middle input
+    T middle = (u0 + u2) / S(2);
+    T delta = middle - u1;
+    auto flat = (delta < epsilon) & (delta > -epsilon);
+    T safe = flat ? T{} + S(1) : delta;
+    T folded = S(2) / safe * (antiderivative1<T, S>(middle) + (antiderivative2<T, S>(u1) - antiderivative2<T, S>(middle)) / safe);
+    T limit = flat ? shape<T, S>((middle + u1) / S(2)) : folded;
+    return close ? limit : regular;
+}
+
+void shapeBlock(float *samples, int count, float drive, int order)
+{
+    if (drive <= 0.0f || count <= order) {
+        return;
+    }
+    const float scale = drive / 1.5f;
+    const int frames = count - order;
+    int i = 0;
+    if (order == 1)
+    {
+        for (; i + 4 <= frames; i += 4)
+        {
+            float4 u1 = load4(samples + i) * scale;
+            float4 u0 = load4(samples + i + 1) * scale;
+            store4(samples + i, adaa1<float4, float>(u0, u1) * 1.5f);
+        }
+        for (; i < frames; ++i) {
+            samples[i] = adaa1<float, float>(samples[i + 1] * scale, samples[i] * scale) * 1.5f;
+        }
+        return;
+    }
+    for (; i + 2 <= frames; i += 2)
+    {
+        double2 u2 = load2(samples + i) * (double)scale;
+        double2 u1 = load2(samples + i + 1) * (double)scale;
+        double2 u0 = load2(samples + i + 2) * (double)scale;
+        store2(samples + i, adaa2<double2, double>(u0, u1, u2) * 1.5);
+    }
+    for (; i < frames; ++i)
+    {
+        double u2 = samples[i] * (double)scale, u1 = samples[i + 1] * (double)scale, u0 = samples[i + 2] * (double)scale;
+        samples[i] = (float)(adaa2<double, double>(u0, u1, u2) * 1.5);
+    }
+}
+
+WaveShaper::WaveShaper(Arena &arena, int max_frames, int order)
+{
+    maxFrames = max_frames;
+    this->order = std::max(1, std::min(MAX_ADAA_ORDER, order));
+    work = arena.allocateArray<float>(max_frames + MAX_ADAA_ORDER, CACHE_LINE);
+}
+
+void WaveShaper::process(float *buffer, int frames, float drive)
+{
+    frames = std::min(frames, maxFrames);
+    if (drive <= 0.0f)
+    {
+        // keep the history current, so turning the drive up later does not click
+        for (int i = std::max(0, frames - order); i < frames; ++i) {
+            std::copy(history + 1, history + order, history);
+            history[order - 1] = buffer[i];
+        }
+        return;
+    }
+    std::copy(history, history + order, work);
+    std::copy(buffer, buffer + frames, work + order);
+    // the last inputs are the history of the next block
+    std::copy(work + frames, work + frames + order, history);
+    shapeBlock(work, frames + order, drive, order);
+    std::copy(work, work + frames, buffer);
+}
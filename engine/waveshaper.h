@@ -0,0 +1,37 @@
+#ifndef SYNTHY_WAVESHAPER_H
+#define SYNTHY_WAVESHAPER_H
+
+#include "arena.h"
+
+// Soft clipping, y = s(drive * x) with s(x) = x - 4x^3/27 up to |x| = 1.5 and +-1 past it, made free of most of its
+// aliasing by antiderivative antialiasing (ADAA) instead of oversampling. First order works on the two latest inputs
+// and delays by half a sample, second order on the three latest and delays by one sample; both are computed several
+// samples at a time, first order in float and second order in double, which it needs for its divided differences.
+const int MAX_ADAA_ORDER = 2;
+
+// For sources that can be rendered at any time: the first order samples are the history, the count - order samples
+// after them are shaped and written from samples[0] on. drive 0 leaves the samples alone
+void shapeBlock(float *samples, int count, float drive, int order);
+
+// for streams, like the master bus: keeps the history between blocks
+class WaveShaper
+{
+public:
+    WaveShaper(Arena &arena, int max_frames, int order);
+    
+    int getOrder() const
+    {
+        return order;
+    }
+    
+    // frames at most max_frames, drive 0 passes the buffer through
+    void process(float *buffer, int frames, float drive);
+    
+private:
+    float *work; // the history followed by the block
+    float history[MAX_ADAA_ORDER] = {};
+    int maxFrames;
+    int order;
+};
+
+#endif
@@ -1,331 +1,1573 @@
 #include <algorithm>
 #include <vector>
 #include <map>
+#include <string>
+#include <complex>
+#include <chrono>
+#include <thread>
+#include <functional>
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <math.h>
 
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_audio.h>
 
-// Hertz to Angular
-#define H2W(hertz) (hertz)*2*(float)M_PI
-// "Safe" pointer delete
-#define DELETE_PTR(x) delete (x); (x) = nullptr
+#include "engine/engine.h"
+#include "engine/fixed_point.h"
+#include "engine/limiter.h"
+#include "engine/meter.h"
+#include "engine/patch_watcher.h"
+#include "engine/preset_bank.h"
+#include "engine/realtime.h"
+#include "engine/resampler.h"
+#include "engine/shm_control.h"
+#include "engine/shm_ring.h"
+#include "engine/snapshot_buffer.h"
+#include "engine/synth.h"
+#include "engine/synth_host.h"
+#include "engine/wave_table.h"
+
+// audio callback, it is responcible for the audio samples generation
+void audio_callback(void *user_data, Uint8 *raw_buffer, int bytes)
+{
+    Sint16 *buffer = (Sint16*)raw_buffer;
+    int length = bytes/2; // 2 bytes per sample for AUDIO_S16SYS
+    Engine *engine = (Engine *)user_data;
+    
+    // mix all the notes!
+    engine->render(buffer, length);
+}
+
+// everything between the engine and the audio device in interactive mode, every part but the engine may be null
+struct DeviceOutput
+{
+    Engine *engine;
+    ShmRing *ring; // other processes read the engine output from it
+    ShmControl *control; // other processes write parameters into it
+    Resampler *resampler; // when the device does not run at SAMPLE_RATE
+    SnapshotBuffer *snapshots; // the window shows the engine output from it
+    float *scratch; // engine output when there is no ring, then the resampled output
+};
+
+static Sint16 toDeviceSample(float sample)
+{
+    return (Sint16)std::max(-32768.0f, std::min(32767.0f, sample * 32768.0f));
+}
 
-const int AMPLITUDE = 20000;
-const int SAMPLE_RATE = 44100;
+// samples the shared parameters once per block, renders straight into the shared ring and converts to the rate of
+// the device; the device gets a 16 bit copy of the result
+void device_audio_callback(void *user_data, Uint8 *raw_buffer, int bytes)
+{
+    Sint16 *buffer = (Sint16*)raw_buffer;
+    int length = bytes/2;
+    DeviceOutput *output = (DeviceOutput *)user_data;
+    
+    if (output->control) {
+        output->control->apply(*output->engine);
+    }
+    if (!output->ring && !output->resampler && !output->snapshots) {
+        output->engine->render(buffer, length);
+        return;
+    }
+    int frames = output->resampler ? output->resampler->inputNeeded(length) : length;
+    for (int done = 0; done < frames; )
+    {
+        int now = frames - done;
+        float *block = output->ring ? output->ring->acquire(now) : output->scratch + done;
+        output->engine->render(block, now);
+        if (output->ring) {
+            output->ring->commit(now);
+        }
+        if (output->snapshots) {
+            output->snapshots->write(block, now);
+        }
+        if (output->resampler) {
+            output->resampler->push(block, now);
+        }
+        else {
+            for (int i = 0; i < now; ++i) {
+                buffer[done + i] = toDeviceSample(block[i]);
+            }
+        }
+        done += now;
+    }
+    if (output->resampler)
+    {
+        output->resampler->pull(output->scratch, length);
+        for (int i = 0; i < length; ++i) {
+            buffer[i] = toDeviceSample(output->scratch[i]);
+        }
+    }
+}
+
+void initializeKeyMap(std::map<SDL_Scancode, Note> &key_to_note, Instrument *instrument)
+{
+    Note note;
+    note.instrument = instrument;
+    
+    // A3
+    note.id = 0;
+    note.freq = 440.0f * powf(2, -12.f/12);
+    key_to_note[SDL_SCANCODE_Z] = note;
+    // A3#
+    note.id++;
+    note.freq = 440.0f * powf(2, -11.f/12);
+    key_to_note[SDL_SCANCODE_S] = note;
+    // B3
+    note.id++;
+    note.freq = 440.0f * powf(2, -10.f/12);
+    key_to_note[SDL_SCANCODE_X] = note;
+    // C4
+    note.id++;
+    note.freq = 440.0f * powf(2, -9.f/12);
+    key_to_note[SDL_SCANCODE_C] = note;
+    // C4#
+    note.id++;
+    note.freq = 440.0f * powf(2, -8.f/12);
+    key_to_note[SDL_SCANCODE_F] = note;
+    // D4
+    note.id++;
+    note.freq = 440.0f * powf(2, -7.f/12);
+    key_to_note[SDL_SCANCODE_V] = note;
+    // D4#
+    note.id++;
+    note.freq = 440.0f * powf(2, -6.f/12);
+    key_to_note[SDL_SCANCODE_G] = note;
+    // E4
+    note.id++;
+    note.freq = 440.0f * powf(2, -5.f/12);
+    key_to_note[SDL_SCANCODE_B] = note;
+    // E4#
+    note.id++;
+    note.freq = 440.0f * powf(2, -4.f/12);
+    key_to_note[SDL_SCANCODE_N] = note;
+    // F4
+    note.id++;
+    note.freq = 440.0f * powf(2, -3.f/12);
+    key_to_note[SDL_SCANCODE_J] = note;
+    // F4#
+    note.id++;
+    note.freq = 440.0f * powf(2, -2.f/12);
+    key_to_note[SDL_SCANCODE_M] = note;
+    // G4
+    note.id++;
+    note.freq = 440.0f * powf(2, -1.f/12);
+    key_to_note[SDL_SCANCODE_K] = note;
+    // G4#
+    note.id++;
+    note.freq = 440.0f * powf(2, 0.f/12);
+    key_to_note[SDL_SCANCODE_COMMA] = note;
+}
+
+
+// ---------------------------------------------------------------------------
+// Offline rendering and golden-output regression tests
+// ---------------------------------------------------------------------------
+
+const uint32_t GOLDEN_NOISE_SEED = 12345u;
+const float GOLDEN_MAX_ABS_ERROR = 2e-3f;   // ~ -54 dBFS
+const float GOLDEN_MAX_SPECTRAL_DB = 1.0f;  // mean log-spectral distance
+const int GOLDEN_FFT_SIZE = 1024;
+
+// single oscillator with a flat envelope, used to pin down every waveform
+class WaveProbe : public Instrument
+{
+public:
+    WaveType waveType;
+    float fmAmplitude;
+    float fmHertz;
+    
+    WaveProbe(WaveType type, float fmAmp = 0.0f, float fmHz = 0.0f)
+    {
+        waveType = type;
+        fmAmplitude = fmAmp;
+        fmHertz = fmHz;
+        envelope.attackTime = 0.01f;
+        envelope.decayTime = 0.01f;
+        envelope.startAmplitude = 1.0f;
+        envelope.sustainAmplitude = 1.0f;
+        envelope.releaseTime = 0.05f;
+    }
+    
+    float wave(float hertz, float t)
+    {
+        return getWave(waveType, t, hertz, fmAmplitude, fmHertz);
+    }
+};
+
+struct ScoreEvent
+{
+    float time;
+    int semitone; // relative to A4
+    bool on;
+};
+
+struct GoldenCase
+{
+    const char *name;
+    Instrument *instrument;
+    std::vector<ScoreEvent> score;
+    float length;
+};
+
+// renders a score offline through the real audio callback
+std::vector<Sint16> renderScore(Instrument *instrument, const std::vector<ScoreEvent> &score, float length, int block_size = 512)
+{
+    Engine engine(1, MAX_NOTES, block_size);
+    engine.seedNoise(GOLDEN_NOISE_SEED);
+    int total = (int)(length * SAMPLE_RATE);
+    std::vector<Sint16> output(total);
+    
+    size_t next_event = 0;
+    int pos = 0;
+    while (pos < total)
+    {
+        while (next_event < score.size() && (int)(score[next_event].time * SAMPLE_RATE) <= pos)
+        {
+            const ScoreEvent &e = score[next_event++];
+            if (e.on) {
+                engine.noteOn(e.semitone, 440.0f * powf(2, e.semitone / 12.f), instrument);
+            }
+            else {
+                engine.noteOff(e.semitone);
+            }
+        }
+        // stop the block at the next event, so events are sample accurate
+        int length_now = std::min(block_size, total - pos);
+        if (next_event < score.size()) {
+            length_now = std::min(length_now, (int)(score[next_event].time * SAMPLE_RATE) - pos);
+        }
+        audio_callback(&engine, (Uint8*)&output[pos], length_now * 2);
+        pos += length_now;
+    }
+    return output;
+}
+
+// mono 16 bit, frames samples follow it
+void writeWavHeader(FILE *file, size_t frames, int sample_rate)
+{
+    uint32_t data_size = (uint32_t)(frames * 2);
+    uint32_t riff_size = 36 + data_size;
+    uint32_t fmt_size = 16;
+    uint16_t format = 1, channels = 1, block_align = 2, bits = 16;
+    uint32_t rate = sample_rate, byte_rate = sample_rate * 2;
+    fwrite("RIFF", 1, 4, file); fwrite(&riff_size, 4, 1, file);
+    fwrite("WAVEfmt ", 1, 8, file); fwrite(&fmt_size, 4, 1, file);
+    fwrite(&format, 2, 1, file); fwrite(&channels, 2, 1, file);
+    fwrite(&rate, 4, 1, file); fwrite(&byte_rate, 4, 1, file);
+    fwrite(&block_align, 2, 1, file); fwrite(&bits, 2, 1, file);
+    fwrite("data", 1, 4, file); fwrite(&data_size, 4, 1, file);
+}
+
+bool writeWav(const std::string &path, const std::vector<Sint16> &samples, int sample_rate)
+{
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    writeWavHeader(file, samples.size(), sample_rate);
+    fwrite(samples.data(), 2, samples.size(), file);
+    fclose(file);
+    return true;
+}
+
+// reads back a mono 16 bit wav file written by writeWav()
+bool readWav(const std::string &path, std::vector<Sint16> &samples)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    char header[44];
+    uint32_t data_size = 0;
+    bool ok = fread(header, 1, 44, file) == 44 && memcmp(header, "RIFF", 4) == 0 && memcmp(header + 36, "data", 4) == 0;
+    if (ok) {
+        memcpy(&data_size, header + 40, 4);
+        samples.resize(data_size / 2);
+        ok = fread(samples.data(), 2, samples.size(), file) == samples.size();
+    }
+    fclose(file);
+    return ok;
+}
+
+// in-place radix-2 FFT, size must be a power of two
+void fft(std::vector<std::complex<float>> &x)
+{
+    size_t n = x.size();
+    for (size_t i = 1, j = 0; i < n; ++i) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            std::swap(x[i], x[j]);
+        }
+    }
+    for (size_t len = 2; len <= n; len <<= 1) {
+        std::complex<float> w_len(cosf(-2.0f * (float)M_PI / len), sinf(-2.0f * (float)M_PI / len));
+        for (size_t i = 0; i < n; i += len) {
+            std::complex<float> w(1.0f, 0.0f);
+            for (size_t k = 0; k < len / 2; ++k) {
+                std::complex<float> a = x[i + k], b = x[i + k + len / 2] * w;
+                x[i + k] = a + b;
+                x[i + k + len / 2] = a - b;
+                w *= w_len;
+            }
+        }
+    }
+}
+
+float maxAbsError(const std::vector<Sint16> &a, const std::vector<Sint16> &b)
+{
+    float error = 0.0f;
+    for (size_t i = 0; i < a.size(); ++i) {
+        error = std::max(error, fabsf((float)(a[i] - b[i]) / 32768.0f));
+    }
+    return error;
+}
+
+// mean log-spectral distance (dB) over Hann windowed frames
+float spectralDistance(const std::vector<Sint16> &a, const std::vector<Sint16> &b)
+{
+    const int n = GOLDEN_FFT_SIZE;
+    // ignore differences below the noise floor, 16 bit rounding alone reaches about -100 dBFS per bin
+    const float floor_db = -80.0f;
+    // scales bins so that a full scale sine reads 0 dBFS (Hann window coherent gain is 0.5)
+    const float scale = 2.0f / (0.5f * n);
+    std::vector<std::complex<float>> fa(n), fb(n);
+    float total = 0.0f;
+    int frames = 0;
+    for (size_t start = 0; start + n <= a.size(); start += n / 2, ++frames)
+    {
+        for (int i = 0; i < n; ++i) {
+            float w = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / (n - 1));
+            fa[i] = w * a[start + i] / 32768.0f;
+            fb[i] = w * b[start + i] / 32768.0f;
+        }
+        fft(fa); fft(fb);
+        float sum = 0.0f;
+        for (int k = 0; k <= n / 2; ++k) {
+            float da = std::max(floor_db, 20.0f * log10f(scale * std::abs(fa[k]) + 1e-12f));
+            float db = std::max(floor_db, 20.0f * log10f(scale * std::abs(fb[k]) + 1e-12f));
+            sum += (da - db) * (da - db);
+        }
+        total += sqrtf(sum / (n / 2 + 1));
+    }
+    return frames > 0 ? total / frames : 0.0f;
+}
+
+std::vector<GoldenCase> goldenCases(Arena &arena)
+{
+    // a held chord plus a short melody exercises attack, decay, sustain and release
+    std::vector<ScoreEvent> chord = {
+        {0.01f, -12, true}, {0.01f, -8, true}, {0.01f, -5, true},
+        {0.40f, 0, true}, {0.50f, 0, false}, {0.55f, 2, true}, {0.65f, 2, false},
+        {0.70f, -12, false}, {0.70f, -8, false}, {0.70f, -5, false},
+    };
+    std::vector<ScoreEvent> tone = { {0.01f, 0, true}, {0.40f, 0, false} };
+    
+    Instrument *bell = arena.create<Bell>(), *harmonica = arena.create<Harmonica>(), *saw = arena.create<PureSaw>();
+    Instrument *sine = arena.create<WaveProbe>(WaveType::SINE), *square = arena.create<WaveProbe>(WaveType::SQUARE);
+    Instrument *triangle = arena.create<WaveProbe>(WaveType::TRIANGLE), *saw_wave = arena.create<WaveProbe>(WaveType::SAW);
+    Instrument *noise = arena.create<WaveProbe>(WaveType::NOISE), *fm = arena.create<WaveProbe>(WaveType::SINE, 0.01f, 5.0f);
+    Instrument *square_4x = arena.create<WaveProbe>(WaveType::SQUARE);
+    square_4x->oversampling = 4;
+    
+    return {
+        {"bell", bell, chord, 1.0f},
+        {"harmonica", harmonica, chord, 1.0f},
+        {"puresaw", saw, chord, 1.0f},
+        {"wave_sine", sine, tone, 0.5f},
+        {"wave_square", square, tone, 0.5f},
+        {"wave_triangle", triangle, tone, 0.5f},
+        {"wave_saw", saw_wave, tone, 0.5f},
+        {"wave_noise", noise, tone, 0.5f},
+        {"wave_sine_fm", fm, tone, 0.5f},
+        {"wave_square_4x", square_4x, tone, 0.5f},
+    };
+}
+
+// renders every golden case and either stores it or compares it with the stored file
+int runGolden(const std::string &dir, bool write, float max_abs, float max_spectral)
+{
+    Arena arena(64 * 1024);
+    std::vector<GoldenCase> cases = goldenCases(arena);
+    int failures = 0;
+    for (const GoldenCase &c : cases)
+    {
+        std::string path = dir + "/" + c.name + ".wav";
+        std::vector<Sint16> rendered = renderScore(c.instrument, c.score, c.length);
+        if (write) {
+            if (!writeWav(path, rendered, SAMPLE_RATE)) {
+                printf("FAIL  %-16s cannot write %s\n", c.name, path.c_str());
+                failures++;
+            }
+            else {
+                printf("WROTE %-16s %s\n", c.name, path.c_str());
+            }
+            continue;
+        }
+        std::vector<Sint16> golden;
+        if (!readWav(path, golden) || golden.size() != rendered.size()) {
+            printf("FAIL  %-16s missing or mismatched golden file %s\n", c.name, path.c_str());
+            failures++;
+            continue;
+        }
+        float abs_error = maxAbsError(rendered, golden);
+        float spectral = spectralDistance(rendered, golden);
+        bool ok = abs_error <= max_abs && spectral <= max_spectral;
+        printf("%s  %-16s max abs error %.6f (limit %.6f), spectral distance %.3f dB (limit %.3f)\n",
+               ok ? "OK  " : "FAIL", c.name, abs_error, max_abs, spectral, max_spectral);
+        failures += ok ? 0 : 1;
+    }
+    printf("%d of %d golden cases failed\n", failures, (int)cases.size());
+    return failures == 0 && checkRealtimeViolations() ? 0 : 1;
+}
+
+
+// ---------------------------------------------------------------------------
+// High polyphony stress benchmark
+// ---------------------------------------------------------------------------
+
+const int STRESS_MAX_VOICES = 10000;
+
+// voice counts to ramp through, 1, 2, 5, 10, 20, 50, ... up to STRESS_MAX_VOICES
+std::vector<int> stressVoiceSteps()
+{
+    std::vector<int> steps;
+    for (int decade = 1; decade <= STRESS_MAX_VOICES; decade *= 10) {
+        for (int m : {1, 2, 5}) {
+            if (decade * m <= STRESS_MAX_VOICES) {
+                steps.push_back(decade * m);
+            }
+        }
+    }
+    return steps;
+}
+
+// renders with the given number of held voices and returns the per buffer render times in ms
+std::vector<double> stressRender(InstrumentId instrument, int voices, int buffer_size, int buffers, int threads)
+{
+    Engine engine(threads, voices, buffer_size);
+    engine.seedNoise(GOLDEN_NOISE_SEED);
+    for (int v = 0; v < voices; ++v) {
+        // held for the whole run
+        engine.noteOn(v, 440.0f * powf(2, (v % 48 - 24) / 12.f), engine.getInstrument(instrument));
+    }
+    
+    std::vector<Sint16> buffer(buffer_size);
+    std::vector<double> times;
+    for (int b = 0; b < buffers; ++b)
+    {
+        auto start = std::chrono::steady_clock::now();
+        audio_callback(&engine, (Uint8*)buffer.data(), buffer_size * 2);
+        auto end = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return times;
+}
+
+// ramps the voice count of every instrument until it can not be rendered in real time any more
+int runStress(int buffer_size, const char *csv_path, int threads)
+{
+    FILE *csv = csv_path ? fopen(csv_path, "w") : stdout;
+    if (!csv) {
+        printf("Error opening %s\n", csv_path);
+        return 1;
+    }
+    const int cores = (int)std::thread::hardware_concurrency();
+    const double budget_ms = 1000.0 * buffer_size / SAMPLE_RATE;
+    const int buffers = std::max(8, SAMPLE_RATE / 2 / buffer_size); // about half a second of audio
+    
+    struct { const char *name; InstrumentId instrument; } instruments[] = {
+        {"bell", InstrumentId::BELL}, {"harmonica", InstrumentId::HARMONICA}, {"puresaw", InstrumentId::PURE_SAW},
+    };
+    
+    fprintf(csv, "instrument,voices,buffer_size,threads,cores,avg_ms,max_ms,budget_ms,realtime_ratio,realtime\n");
+    for (auto &entry : instruments)
+    {
+        // renders one voice count, writes its csv row and tells if it kept up with real time
+        auto measure = [&](int voices) {
+            std::vector<double> times = stressRender(entry.instrument, voices, buffer_size, buffers, threads);
+            double total = 0.0, worst = 0.0;
+            for (double t : times) {
+                total += t;
+                worst = std::max(worst, t);
+            }
+            double avg = total / times.size();
+            // real time means every buffer, not just the average one, is ready before the device needs it
+            bool realtime = worst < budget_ms;
+            fprintf(csv, "%s,%d,%d,%d,%d,%.4f,%.4f,%.4f,%.3f,%d\n", entry.name, voices, buffer_size, threads, cores,
+                    avg, worst, budget_ms, budget_ms / avg, realtime ? 1 : 0);
+            fflush(csv);
+            return realtime;
+        };
+        
+        int max_voices = 0, failed_voices = 0;
+        for (int voices : stressVoiceSteps())
+        {
+            if (!measure(voices)) {
+                failed_voices = voices;
+                break;
+            }
+            max_voices = voices;
+        }
+        // narrow down the ceiling between the last passing and the first failing step (to ~5%)
+        while (failed_voices - max_voices > std::max(1, max_voices / 20))
+        {
+            int voices = (max_voices + failed_voices) / 2;
+            if (measure(voices)) {
+                max_voices = voices;
+            }
+            else {
+                failed_voices = voices;
+            }
+        }
+        fprintf(stderr, "%-10s max voices in real time: %d (buffer %d, budget %.2f ms)\n",
+                entry.name, max_voices, buffer_size, budget_ms);
+    }
+    if (csv != stdout) {
+        fclose(csv);
+    }
+    return checkRealtimeViolations() ? 0 : 1;
+}
+
+// renders the same voices with 1 to N render threads and reports the speedup over a single thread
+int runScaling(int voices, int buffer_size, int max_threads)
+{
+    const int buffers = std::max(8, SAMPLE_RATE / buffer_size); // about a second of audio
+    const double budget_ms = 1000.0 * buffer_size / SAMPLE_RATE;
+    
+    printf("threads,voices,buffer_size,avg_ms,budget_ms,speedup,efficiency\n");
+    double single = 0.0;
+    for (int threads = 1; threads <= max_threads; ++threads)
+    {
+        std::vector<double> times = stressRender(InstrumentId::BELL, voices, buffer_size, buffers, threads);
+        double avg = 0.0;
+        for (double t : times) {
+            avg += t / times.size();
+        }
+        if (threads == 1) {
+            single = avg;
+        }
+        double speedup = single / avg;
+        printf("%d,%d,%d,%.4f,%.4f,%.3f,%.3f\n", threads, voices, buffer_size, avg, budget_ms, speedup, speedup / threads);
+    }
+    return checkRealtimeViolations() ? 0 : 1;
+}
+
+// converts 16 bit samples at SAMPLE_RATE to rate, the length in seconds stays the same
+std::vector<Sint16> resampleTo(const std::vector<Sint16> &samples, int rate)
+{
+    const int block = 4096;
+    Resampler resampler(SAMPLE_RATE, rate, block);
+    size_t total = (size_t)((double)samples.size() * rate / SAMPLE_RATE);
+    std::vector<Sint16> output(total);
+    std::vector<float> input(block * (SAMPLE_RATE / rate + 1) + 2 * RESAMPLER_TAPS), converted(block);
+    size_t read = 0;
+    for (size_t done = 0; done < total; )
+    {
+        int frames = (int)std::min<size_t>(block, total - done);
+        int needed = resampler.inputNeeded(frames);
+        // silence after the end, the filter looks ahead of the last sample
+        for (int i = 0; i < needed; ++i, ++read) {
+            input[i] = read < samples.size() ? samples[read] / 32768.0f : 0.0f;
+        }
+        resampler.push(input.data(), needed);
+        resampler.pull(converted.data(), frames);
+        for (int i = 0; i < frames; ++i) {
+            output[done + i] = toDeviceSample(converted[i]);
+        }
+        done += frames;
+    }
+    return output;
+}
+
+// renders the frames from start to end of a score as if it had played from the beginning: the events before start
+// are replayed without rendering, dropping the notes that went silent in between. Blocks go to consume as they are
+// rendered
+void renderScoreRange(const GoldenCase &c, int start, int end, const std::function<void(const float*, int)> &consume)
+{
+    const int block_size = 512;
+    const int block_frames = SAMPLE_RATE * LOUDNESS_BLOCK_MS / 1000;
+    Engine engine(1, MAX_NOTES, block_size);
+    engine.seedNoise(GOLDEN_NOISE_SEED);
+    std::vector<float> block(block_size);
+    size_t next_event = 0;
+    int pos = 0;
+    while (pos < end)
+    {
+        while (next_event < c.score.size() && (int)(c.score[next_event].time * SAMPLE_RATE) <= std::max(pos, start))
+        {
+            const ScoreEvent &e = c.score[next_event++];
+            engine.seek(std::max(0, (int)(e.time * SAMPLE_RATE)));
+            // rendered blocks drop their silent notes themselves
+            if (pos < start) {
+                engine.dropSilentNotes();
+            }
+            if (e.on) {
+                engine.noteOn(e.semitone, 440.0f * powf(2, e.semitone / 12.f), c.instrument);
+            }
+            else {
+                engine.noteOff(e.semitone);
+            }
+        }
+        pos = std::max(pos, start);
+        engine.seek(pos);
+        // blocks also end on every meter block, so a segment starting on one renders the same blocks as the whole
+        // score and its envelopes round the same way
+        int length_now = std::min({block_size, end - pos, block_frames - pos % block_frames});
+        if (next_event < c.score.size()) {
+            length_now = std::min(length_now, (int)(c.score[next_event].time * SAMPLE_RATE) - pos);
+        }
+        engine.render(block.data(), length_now);
+        consume(block.data(), length_now);
+        pos += length_now;
+    }
+}
+
+// the 16 bit WAV output of the normalized export, converted to its rate on the way
+struct WavStream
+{
+    FILE *file;
+    Resampler *resampler; // null at SAMPLE_RATE
+    std::vector<float> pending; // input the resampler did not take yet
+    std::vector<float> converted;
+    std::vector<Sint16> samples;
+    size_t written;
+    size_t total;
+};
+
+const int WAV_STREAM_BLOCK = 4096;
+
+void writeWavStream(WavStream &stream, const float *in, int frames)
+{
+    stream.pending.insert(stream.pending.end(), in, in + frames);
+    size_t used = 0;
+    while (stream.written < stream.total)
+    {
+        int now = (int)std::min<size_t>(WAV_STREAM_BLOCK, stream.total - stream.written);
+        int needed = stream.resampler ? stream.resampler->inputNeeded(now) : now;
+        if (stream.pending.size() - used < (size_t)needed) {
+            break;
+        }
+        if (stream.resampler)
+        {
+            stream.resampler->push(stream.pending.data() + used, needed);
+            stream.resampler->pull(stream.converted.data(), now);
+        }
+        else {
+            std::copy(stream.pending.data() + used, stream.pending.data() + used + now, stream.converted.data());
+        }
+        for (int i = 0; i < now; ++i) {
+            stream.samples[i] = toDeviceSample(stream.converted[i]);
+        }
+        fwrite(stream.samples.data(), 2, now, stream.file);
+        used += needed;
+        stream.written += now;
+    }
+    stream.pending.erase(stream.pending.begin(), stream.pending.begin() + used);
+}
+
+// scores are rendered in segments of whole meter blocks, each on its own thread; a segment starts rendering a
+// little earlier, so the master bus, the meter and the limiter have settled when its first frame comes
+const float EXPORT_SEGMENT_SECONDS = 10.0f;
+const int EXPORT_PREROLL_FRAMES = 5 * SAMPLE_RATE * LOUDNESS_BLOCK_MS / 1000;
+const float EXPORT_TRUE_PEAK_DB = -1.0f;
+
+// runs work(segment) for every segment, threads segments at a time; done(segment) runs in order after each wave
+void forEachSegment(int segments, int threads, const std::function<void(int)> &work, const std::function<void(int)> &done)
+{
+    for (int first = 0; first < segments; first += threads)
+    {
+        int last = std::min(segments, first + threads);
+        std::vector<std::thread> workers;
+        for (int s = first + 1; s < last; ++s) {
+            workers.emplace_back(work, s);
+        }
+        work(first);
+        for (std::thread &worker : workers) {
+            worker.join();
+        }
+        for (int s = first; s < last; ++s) {
+            done(s);
+        }
+    }
+}
+
+// Two passes over a golden score: the first only measures the integrated loudness, keeping ten numbers per second,
+// the second renders again with the one gain that brings it to target_lufs, through a true peak limiter, and
+// streams the result to the WAV file. Both passes render their segments in parallel
+int runNormalizedExport(const GoldenCase &c, int rate, const std::string &path, float target_lufs, int threads,
+                        float segment_seconds = EXPORT_SEGMENT_SECONDS)
+{
+    const int total = (int)(c.length * SAMPLE_RATE);
+    const int block_frames = SAMPLE_RATE * LOUDNESS_BLOCK_MS / 1000;
+    const int segment_frames = std::max(1, (int)lroundf(segment_seconds * 1000 / LOUDNESS_BLOCK_MS)) * block_frames;
+    const int segments = (total + segment_frames - 1) / segment_frames;
+    
+    // pass 1: the K-weighted power of every whole block
+    std::vector<double> powers(total / block_frames);
+    forEachSegment(segments, threads, [&](int s) {
+        int first = s * segment_frames;
+        int end = std::min(total, first + segment_frames);
+        int start = std::max(0, first - EXPORT_PREROLL_FRAMES);
+        LoudnessMeter meter(1);
+        uint64_t blocks = 0;
+        renderScoreRange(c, start, end, [&](const float *block, int frames) {
+            meter.process(block, frames);
+            if (meter.getBlocks() == blocks) {
+                return;
+            }
+            blocks = meter.getBlocks();
+            int index = (int)((start + blocks * block_frames) / block_frames) - 1;
+            if (index * block_frames >= first && index < (int)powers.size()) {
+                powers[index] = meter.getBlockPower();
+            }
+        });
+    }, [](int) {});
+    float loudness = integratedLoudness(powers.data(), (int)powers.size());
+    float gain_db = loudness > METER_FLOOR_LUFS ? target_lufs - loudness : 0.0f;
+    float gain = powf(10.0f, gain_db / 20.0f);
+    
+    // pass 2
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        printf("Could not write %s\n", path.c_str());
+        return 1;
+    }
+    WavStream stream = {file, nullptr, {}, std::vector<float>(WAV_STREAM_BLOCK), std::vector<Sint16>(WAV_STREAM_BLOCK),
+                        0, (size_t)((double)total * rate / SAMPLE_RATE)};
+    if (rate != SAMPLE_RATE) {
+        stream.resampler = new Resampler(SAMPLE_RATE, rate, WAV_STREAM_BLOCK);
+    }
+    writeWavHeader(file, stream.total, rate);
+    std::vector<std::vector<float>> rendered(segments);
+    forEachSegment(segments, threads, [&](int s) {
+        int first = s * segment_frames;
+        int end = std::min(total, first + segment_frames);
+        int start = std::max(0, first - EXPORT_PREROLL_FRAMES);
+        Arena arena(1024 * 1024);
+        TruePeakLimiter limiter(arena, 512, EXPORT_TRUE_PEAK_DB);
+        // the limiter delays, render that much further
+        int pos = start - limiter.getLatency();
+        std::vector<float> &out = rendered[s];
+        out.resize(end - first);
+        std::vector<float> block(512);
+        renderScoreRange(c, start, end + limiter.getLatency(), [&](const float *in, int frames) {
+            for (int i = 0; i < frames; ++i) {
+                block[i] = in[i] * gain;
+            }
+            limiter.process(block.data(), frames);
+            for (int i = 0; i < frames; ++i, ++pos) {
+                if (pos >= first && pos < end) {
+                    out[pos - first] = block[i];
+                }
+            }
+        });
+    }, [&](int s) {
+        writeWavStream(stream, rendered[s].data(), (int)rendered[s].size());
+        std::vector<float>().swap(rendered[s]);
+    });
+    // the resampler looks ahead of the last frame
+    std::vector<float> silence(RESAMPLER_TAPS, 0.0f);
+    while (stream.written < stream.total) {
+        writeWavStream(stream, silence.data(), (int)silence.size());
+    }
+    DELETE_PTR(stream.resampler);
+    fclose(file);
+    printf("%s: %.1f LUFS integrated, gain %+.1f dB to %.1f LUFS, true peak limited to %.1f dBTP\n",
+           c.name, loudness, gain_db, target_lufs, EXPORT_TRUE_PEAK_DB);
+    return 0;
+}
+
+// renders one of the golden scores to a WAV file at any sample rate, normalized to target_lufs unless it is nullptr
+int runExport(const char *name, int rate, const std::string &path, const char *target_lufs, int threads,
+              float segment_seconds)
+{
+    Arena arena(64 * 1024);
+    for (const GoldenCase &c : goldenCases(arena))
+    {
+        if (strcmp(c.name, name) != 0) {
+            continue;
+        }
+        if (target_lufs) {
+            return runNormalizedExport(c, rate, path, (float)atof(target_lufs), threads, segment_seconds);
+        }
+        std::vector<Sint16> rendered = renderScore(c.instrument, c.score, c.length);
+        if (rate != SAMPLE_RATE) {
+            rendered = resampleTo(rendered, rate);
+        }
+        if (!writeWav(path, rendered, rate)) {
+            printf("Could not write %s\n", path.c_str());
+            return 1;
+        }
+        return 0;
+    }
+    printf("Unknown score %s\n", name);
+    return 1;
+}
+
+// exports every golden score normalized in one segment and in segments of segment_seconds, into dir, and checks
+// that both files are the same sample for sample. The noise of a segment starts from the seed of its note, so the
+// scores with noise are left out
+int runExportCheck(const std::string &dir, float segment_seconds, int threads)
+{
+    Arena arena(64 * 1024);
+    int failures = 0, checked = 0;
+    for (const GoldenCase &c : goldenCases(arena))
+    {
+        if (strcmp(c.name, "harmonica") == 0 || strcmp(c.name, "wave_noise") == 0) {
+            continue;
+        }
+        std::string single = dir + "/" + c.name + "_single.wav", stitched = dir + "/" + c.name + "_segments.wav";
+        std::vector<Sint16> expected, rendered;
+        if (runNormalizedExport(c, SAMPLE_RATE, single, -16.0f, 1, c.length) != 0
+            || runNormalizedExport(c, SAMPLE_RATE, stitched, -16.0f, threads, segment_seconds) != 0
+            || !readWav(single, expected) || !readWav(stitched, rendered) || expected.size() != rendered.size())
+        {
+            printf("FAIL  %-16s could not export\n", c.name);
+            failures++;
+            continue;
+        }
+        size_t differ = 0;
+        for (size_t i = 0; i < expected.size(); ++i) {
+            differ += expected[i] != rendered[i] ? 1 : 0;
+        }
+        printf("%s  %-16s %zu of %zu samples differ\n", differ == 0 ? "OK  " : "FAIL", c.name, differ, expected.size());
+        failures += differ == 0 ? 0 : 1;
+        checked++;
+    }
+    printf("%d of %d segmented exports failed\n", failures, checked);
+    return failures == 0 ? 0 : 1;
+}
+
+// feeds the true peak limiter inputs whose required gain keeps changing, a sine that swells to 4 times full scale
+// and decaying bursts with spikes, and checks that no output sample goes above the ceiling
+int runLimiterCheck()
+{
+    const int frames = 2 * SAMPLE_RATE;
+    const int block = 512;
+    const float ceiling = powf(10.0f, EXPORT_TRUE_PEAK_DB / 20.0f);
+    const char *names[] = {"rising sine", "decaying bursts"};
+    initTables();
+    int failures = 0;
+    for (int signal = 0; signal < 2; ++signal)
+    {
+        std::vector<float> input(frames);
+        for (int i = 0; i < frames; ++i)
+        {
+            float t = (float)i / SAMPLE_RATE;
+            if (signal == 0) {
+                input[i] = 4.0f * t / 2.0f * sinf(2.0f * (float)M_PI * 997.0f * t);
+            }
+            else {
+                // bursts that decay for hundreds of frames, longer than the look-ahead, so the required gain keeps
+                // rising, with spikes on top
+                input[i] = (6.0f * expf(-(float)(i % 1000) / 215) + 0.9f) * (i % 97 == 0 ? 1.2f : 1.0f);
+            }
+        }
+        // a fast release follows the running minimum of the look-ahead closely, a wrong minimum shows at once
+        Arena arena(1024 * 1024);
+        TruePeakLimiter limiter(arena, block, EXPORT_TRUE_PEAK_DB, signal == 0 ? 50.0f : 1.0f);
+        float peak = 0.0f;
+        for (int done = 0; done < frames; done += block)
+        {
+            int now = std::min(block, frames - done);
+            limiter.process(&input[done], now);
+            for (int i = 0; i < now; ++i) {
+                peak = std::max(peak, fabsf(input[done + i]));
+            }
+        }
+        bool ok = peak <= ceiling * 1.0001f;
+        printf("%s  %-16s peak %.6f (ceiling %.6f)\n", ok ? "OK  " : "FAIL", names[signal], peak, ceiling);
+        failures += ok ? 0 : 1;
+    }
+    printf("%d of 2 limiter cases failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
 
-class EnvelopeADSR
+// renders the harmonica's squares far into the clock with the fixed point oscillators and checks that only a small
+// share of their samples takes the float edge decision and that the output is still a clean square of the right pitch
+int runEdgeCheck()
 {
-public:
-    float attackTime;
-    float decayTime;
-    float releaseTime;
-    
-    float sustainAmplitude;
-    float startAmplitude;
-    
-    EnvelopeADSR()
+    const int count = SAMPLE_RATE / 10;
+    const int64_t firsts[] = {0, 441000, 100000000, 10000000000};
+    const float partials[][2] = {{440.0f, 0.001f}, {660.0f, 0.0f}, {880.0f, 0.0f}};
+    initTables();
+    int failures = 0, cases = 0;
+    for (const auto &partial : partials)
     {
-        attackTime = 0.01f;
-        decayTime = 1.0f;
-        startAmplitude = 1.0f;
-        sustainAmplitude = 0.0f;
-        releaseTime = 1.0f;
+        for (int64_t first : firsts)
+        {
+            float hertz = partial[0];
+            double share = squareEdgeFloatShare(hertz, partial[1], first + count, SAMPLE_RATE);
+            std::vector<int16_t> out(count, 0);
+            addWaveQ15(WaveType::SQUARE, hertz, partial[1], 5.0f, first, SAMPLE_RATE, count, Q15_ONE, out.data());
+            const int16_t level = mulQ15((int16_t)FIXED_SCALE, Q15_ONE);
+            int edges = 0, wrong = 0;
+            for (int i = 0; i < count; ++i)
+            {
+                wrong += abs(out[i]) != level ? 1 : 0;
+                edges += i > 0 && (out[i] > 0) != (out[i - 1] > 0) ? 1 : 0;
+            }
+            int expected = (int)lround(2.0 * hertz * count / SAMPLE_RATE);
+            bool ok = share <= 1.0 / 32 && wrong == 0 && abs(edges - expected) <= 2;
+            printf("%s  %4.0f Hz from sample %11lld  float share %.4f, %d edges (%d expected), %d bad samples\n",
+                   ok ? "OK  " : "FAIL", hertz, (long long)first, share, edges, expected, wrong);
+            failures += ok ? 0 : 1;
+            cases++;
+        }
     }
-    
-    float getAmplitude(float t, float timeOn, float timeOff)
+    printf("%d of %d square edge cases failed\n", failures, cases);
+    return failures == 0 ? 0 : 1;
+}
+
+// drives the C API with notes that start on adjacent frames, the sub-blocks between them are one frame long
+// and every note is still in its attack at their end. The notes are passed as events once, and once as
+// note on calls between short renders, the way the CLAP plugin splits host blocks
+int runApiCheck()
+{
+    const int frames = 256;
+    const int offsets[][3] = {{0, 1, 2}, {5, 6, 7}, {0, 0, 1}};
+    const int case_count = sizeof(offsets) / sizeof(offsets[0]);
+    const char *modes[] = {"events", "calls"};
+    int failures = 0;
+    for (int mode = 0; mode < 2; ++mode)
     {
-        float amplitude = 0.0f;
-        
-        float lifeTime = t - timeOn;
-        if (timeOn > timeOff)
+        for (const auto &frame : offsets)
         {
-            // ADS
-            // Attack
-            if (lifeTime <= attackTime){
-                amplitude = (lifeTime / attackTime) * startAmplitude;
+            synth *s = synth_create(1, 16);
+            if (!s) {
+                printf("Could not create a synth\n");
+                return 1;
             }
-            // Decay
-            else if (lifeTime <= attackTime + decayTime) {
-                amplitude = (lifeTime - attackTime) / decayTime * (sustainAmplitude - startAmplitude) + startAmplitude;
+            synth_event events[3];
+            for (int i = 0; i < 3; ++i) {
+                events[i] = {frame[i], SYNTH_EVENT_NOTE_ON, i, SYNTH_INSTRUMENT_BELL, 220.0f * (i + 1)};
+            }
+            std::vector<float> out(frames);
+            int dropped = 0;
+            if (mode == 0) {
+                dropped = synth_render_events(s, out.data(), frames, events, 3);
             }
-            // Sustain
             else {
-                amplitude = sustainAmplitude;
+                int done = 0;
+                for (const synth_event &e : events)
+                {
+                    if (e.frame > done) {
+                        synth_render(s, &out[done], e.frame - done);
+                        done = e.frame;
+                    }
+                    dropped += synth_note_on(s, e.note_id, e.hertz, e.instrument) != 0 ? 1 : 0;
+                }
+                synth_render(s, &out[done], frames - done);
             }
+            int active = synth_active_notes(s);
+            bool ok = dropped == 0 && active == 3;
+            printf("%s  %-6s at %d %d %d  %d active, %d dropped\n", ok ? "OK  " : "FAIL", modes[mode], frame[0],
+                   frame[1], frame[2], active, dropped);
+            failures += ok ? 0 : 1;
+            synth_destroy(s);
         }
-        else {
-            // Release
-            lifeTime = timeOff - timeOn;
-            float releaseAmplitude = 0.0f;
-            
-            if (lifeTime <= attackTime) {
-                releaseAmplitude = (lifeTime / attackTime) * startAmplitude;
-            }
-            else if (lifeTime <= (attackTime + decayTime)) {
-                releaseAmplitude = ((lifeTime - attackTime) / decayTime) * (sustainAmplitude - startAmplitude) + startAmplitude;
-            }
-            if (lifeTime > (attackTime + decayTime)) {
-                releaseAmplitude = sustainAmplitude;
-            }
-            amplitude = ((t - timeOff) / releaseTime) * (0.0 - releaseAmplitude) + releaseAmplitude;
+    }
+    printf("%d of %d C API cases failed\n", failures, 2 * case_count);
+    return failures == 0 ? 0 : 1;
+}
+
+// renders many independent synths on one shared set of threads, the way a game server or batch renderer would
+int runHost(int synth_count, int voices, int buffer_size, int threads)
+{
+    const int buffers = std::max(8, SAMPLE_RATE / buffer_size); // about a second of audio
+    const double budget_ms = 1000.0 * buffer_size / SAMPLE_RATE;
+    
+    SynthHost host(threads, synth_count, buffer_size);
+    for (int i = 0; i < synth_count; ++i)
+    {
+        int index = host.addSynth(voices);
+        if (index < 0) {
+            printf("Could not allocate synth %d\n", i);
+            return 1;
         }
-        
-        if (amplitude < 0.0000f) {
-            amplitude = 0.0f;
+        Engine *engine = host.getEngine(index);
+        engine->seedNoise(GOLDEN_NOISE_SEED + i);
+        InstrumentId instrument = (InstrumentId)(i % (int)InstrumentId::COUNT);
+        for (int v = 0; v < voices; ++v) {
+            engine->noteOn(v, 440.0f * powf(2, ((i + v) % 48 - 24) / 12.f), engine->getInstrument(instrument));
         }
-        
-        return amplitude;
     }
     
-};
+    double avg = 0.0, worst = 0.0;
+    for (int b = 0; b < buffers; ++b)
+    {
+        auto start = std::chrono::steady_clock::now();
+        host.render(buffer_size);
+        auto end = std::chrono::steady_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(end - start).count();
+        avg += ms / buffers;
+        worst = std::max(worst, ms);
+    }
+    printf("synths,voices,buffer_size,threads,avg_ms,max_ms,budget_ms,realtime\n");
+    printf("%d,%d,%d,%d,%.4f,%.4f,%.4f,%d\n", synth_count, voices, buffer_size, host.getThreadCount(),
+           avg, worst, budget_ms, worst <= budget_ms ? 1 : 0);
+    return checkRealtimeViolations() ? 0 : 1;
+}
 
-enum class WaveType
+// a hardware event counter of the calling thread, user space only; -1 where perf events are not allowed
+int openCounter(uint32_t type, uint64_t config)
 {
-    SINE, SQUARE, TRIANGLE, SAW, NOISE
-};
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
 
-// oscilator function (with Frequency Modulation, FM)
-float getWave(WaveType wave_type, float t, float hertz, float fmAmplitude=0, float fmHertz=0)
+// events counted while the counter was on, -1 without a counter
+long long readCounter(int counter)
 {
-    float answer = 0.0f;
-    float freq = H2W(hertz) * t + fmAmplitude * hertz * sinf(H2W(fmHertz) * t);
-    switch (wave_type) {
-        case WaveType::SINE:
-            return sinf(freq);
-            break;
-        case WaveType::SQUARE:
-            return sinf(freq) > 0 ? 1 : -1;
-            break;
-        case WaveType::TRIANGLE:
-            return asinf(sinf(freq)) * 2.0f / (float)M_PI;
-            break;
-        case WaveType::SAW:
-            answer = 0.0f;
-            for (int i=1; i<40; ++i) {
-                answer += sinf((float)i * freq) / (float)i;
-            }
-            return answer * 2.0f / (float)M_PI;
-            break;
-        case WaveType::NOISE:
-            return 2.0f * (float)rand()/(float)RAND_MAX - 1.0;
-            break;
+    long long value = -1;
+    if (counter < 0 || read(counter, &value, sizeof(value)) != sizeof(value)) {
+        return -1;
     }
+    return value;
 }
 
-class Instrument
+// plays many voices, each from its own table out of a large bank, with the tables stored as floats, 16 bit integers
+// and half floats; the compact ones fit twice as many tables in every cache level. Every table of a compact format
+// must play within its tolerance of the float table: 16 bit steps are 3e-5, half floats have 11 significant bits
+int runTableBench(int voices, int table_count)
 {
-public:
-    float volume;
-    EnvelopeADSR envelope;
+    const int frames = 256;
+    const int blocks = std::max(4, SAMPLE_RATE * 2 / frames / std::max(1, voices / 64)); // fewer for many voices
+    const char *names[] = {"float", "int16", "half"};
+    const float tolerances[] = {0.0f, 1e-4f, 1e-3f};
+    initTables();
     
-    Instrument()
-    {
-        volume = 1.0;
+    // the same harmonics for every format, different ones for every table; they add up to at most 2.72, scaled to
+    // stay within the -1..1 of the 16 bit tables
+    std::vector<float> source((size_t)table_count * (WAVE_TABLE_SIZE + 1));
+    for (int t = 0; t < table_count; ++t) {
+        for (int i = 0; i <= WAVE_TABLE_SIZE; ++i)
+        {
+            double phase = 2.0 * M_PI * i / WAVE_TABLE_SIZE;
+            double sample = 0.0;
+            for (int h = 1; h <= 8; ++h) {
+                sample += sin(h * phase + t) / (h + t % 5);
+            }
+            source[(size_t)t * (WAVE_TABLE_SIZE + 1) + i] = (float)(sample * 0.35);
+        }
     }
-    virtual ~Instrument() {}
     
-    virtual float sound(float hertz, float t, float timeOn, float timeOff, bool &noteIsAlive)=0;
-};
+    int l1_counter = openCounter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                                     | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    int llc_counter = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    if (l1_counter < 0 || llc_counter < 0) {
+        fprintf(stderr, "no cache counters (perf_event_paranoid?), only times are measured\n");
+    }
+    printf("format,tables,table_bytes,bank_kb,voices,ns_per_sample,l1d_misses_per_sample,llc_misses_per_sample,"
+           "max_error\n");
+    std::vector<float> mix(frames), wave(frames);
+    std::vector<float> expected((size_t)table_count * frames); // a block of every float table
+    int failures = 0;
+    for (int f = 0; f < 3; ++f)
+    {
+        TableFormat format = (TableFormat)f;
+        size_t bytes = waveTableBytes(format);
+        std::vector<unsigned char> bank(bytes * table_count);
+        for (int t = 0; t < table_count; ++t) {
+            storeWaveTable(&source[(size_t)t * (WAVE_TABLE_SIZE + 1)], format, &bank[t * bytes]);
+        }
+        // a block of every table against the float one, an interval that is no whole number of table steps
+        float max_error = 0.0f;
+        for (int t = 0; t < table_count; ++t)
+        {
+            WaveTable table = {&bank[t * bytes], format};
+            renderWaveTable(table, 441.3f, 0.0f, 0.0f, 0, SAMPLE_RATE, frames, wave.data());
+            float *reference = &expected[(size_t)t * frames];
+            for (int i = 0; i < frames; ++i)
+            {
+                if (format == TableFormat::FLOAT) {
+                    reference[i] = wave[i];
+                }
+                max_error = std::max(max_error, std::abs(wave[i] - reference[i]));
+            }
+        }
+        for (int counter : {l1_counter, llc_counter}) {
+            ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+            ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (int b = 0; b < blocks; ++b)
+        {
+            std::fill(mix.begin(), mix.end(), 0.0f);
+            for (int v = 0; v < voices; ++v)
+            {
+                // neighbouring voices read tables far apart
+                WaveTable table = {&bank[(size_t)v * 7919 % table_count * bytes], format};
+                renderWaveTable(table, 55.0f * powf(2, (v % 60) / 12.f), 0.0f, 0.0f, (int64_t)b * frames,
+                                SAMPLE_RATE, frames, wave.data());
+                for (int i = 0; i < frames; ++i) {
+                    mix[i] += wave[i];
+                }
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        for (int counter : {l1_counter, llc_counter}) {
+            ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+        }
+        double samples = (double)blocks * frames * voices;
+        double ns = std::chrono::duration<double, std::nano>(end - start).count() / samples;
+        long long l1 = readCounter(l1_counter), llc = readCounter(llc_counter);
+        printf("%s,%d,%zu,%zu,%d,%.3f,%.4f,%.4f,%.6f\n", names[f], table_count, bytes, bytes * table_count / 1024,
+               voices, ns, l1 >= 0 ? l1 / samples : -1.0, llc >= 0 ? llc / samples : -1.0, max_error);
+        if (max_error > tolerances[f])
+        {
+            fprintf(stderr, "%s tables are off by %f, more than %f from the float tables\n", names[f], max_error,
+                    tolerances[f]);
+            failures++;
+        }
+    }
+    for (int counter : {l1_counter, llc_counter}) {
+        if (counter >= 0) {
+            close(counter);
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
 
-class Bell : public Instrument
+// reads the output ring of a running synth in place and saves the given number of seconds as a WAV file
+int runShmRecord(const char *name, float seconds, const std::string &path)
 {
-public:
-    Bell()
-    {
-        envelope.attackTime = 0.01f;
-        envelope.decayTime = 1.0f;
-        envelope.startAmplitude = 1.0f;
-        envelope.sustainAmplitude = 0.0f;
-        envelope.releaseTime = 1.0f;
+    ShmRing ring;
+    if (!ring.open(name)) {
+        printf("Could not open output ring %s\n", name);
+        return 1;
     }
-    
-    float sound(float hertz, float t, float timeOn, float timeOff, bool &noteIsAlive)
+    std::vector<Sint16> samples;
+    size_t wanted = (size_t)(seconds * SAMPLE_RATE);
+    uint64_t pos = ring.getWritePos();
+    uint64_t lost = 0;
+    while (samples.size() < wanted)
     {
-        float amplitude = envelope.getAmplitude(t, timeOn, timeOff);
-        noteIsAlive = amplitude > 0.0f;
-        return volume * amplitude * (
-                                    + 1.0f * getWave(WaveType::SINE, t, hertz * 2.0f, 0.001f, 5.0f)
-                                    + 0.5f * getWave(WaveType::SINE, t, hertz * 3.0f)
-                                    + 0.25f * getWave(WaveType::SINE, t, hertz * 4.0f));
+        if (!ring.wait(pos, 1000)) {
+            printf("Output ring %s is idle\n", name);
+            continue;
+        }
+        uint64_t start = pos;
+        int frames = (int)std::min<size_t>(wanted - samples.size(), ring.getCapacity());
+        const float *block = ring.peek(pos, frames);
+        lost += pos - start;
+        if (!block) {
+            continue;
+        }
+        size_t first = samples.size();
+        for (int i = 0; i < frames; ++i) {
+            samples.push_back((Sint16)std::max(-32768.0f, std::min(32767.0f, block[i] * 32768.0f)));
+        }
+        // the writer got around the ring while these were copied, drop them
+        if (ring.lapped(pos)) {
+            samples.resize(first);
+            continue;
+        }
+        pos += frames;
     }
-};
-class Harmonica : public Instrument
+    if (lost > 0) {
+        printf("Lost %llu frames, the reader fell behind\n", (unsigned long long)lost);
+    }
+    if (!writeWav(path, samples, SAMPLE_RATE)) {
+        printf("Could not write %s\n", path.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+// checks that a reader exactly one ring behind the writer keeps its frames until the writer claims the next block,
+// and counts as lapped from then on, while that block is still being rendered
+int runRingCheck()
 {
-public:
-    Harmonica()
-    {
-        envelope.attackTime = 0.1f;
-        envelope.decayTime = 0.01f;
-        envelope.startAmplitude = 1.0f;
-        envelope.sustainAmplitude = 0.8f;
-        envelope.releaseTime = 0.1f;
+    const int capacity = 1024;
+    const int block = 256;
+    char name[64];
+    snprintf(name, sizeof(name), "synthy-ring-check-%d", (int)getpid());
+    ShmRing writer, reader;
+    if (!writer.create(name, capacity) || !reader.open(name)) {
+        printf("Could not create ring %s\n", name);
+        return 1;
     }
-    
-    float sound(float hertz, float t, float timeOn, float timeOff, bool &noteIsAlive)
+    for (int done = 0; done < capacity; done += block)
     {
-        float amplitude = envelope.getAmplitude(t, timeOn, timeOff);
-        noteIsAlive = amplitude > 0.0f;
-        return volume * amplitude * (
-                                     + 1.0f * getWave(WaveType::SQUARE, t, hertz, 0.001f, 5.0f)
-                                     + 0.5f * getWave(WaveType::SQUARE, t, hertz * 1.5f)
-                                     + 0.25f * getWave(WaveType::SQUARE, t, hertz * 2.0f)
-                                     + 0.05f * getWave(WaveType::NOISE, t, 0.0f));
+        int frames = block;
+        float *frame = writer.acquire(frames);
+        for (int i = 0; i < frames; ++i) {
+            frame[i] = (float)(done + i);
+        }
+        writer.commit(frames);
     }
-};
-class PureSaw : public Instrument
+    int failures = 0;
+    uint64_t pos = 0;
+    int frames = block;
+    const float *behind = reader.peek(pos, frames);
+    if (!behind || pos != 0 || frames != block || behind[0] != 0.0f || reader.lapped(pos)) {
+        printf("FAIL a reader one ring behind lost frames it may still read\n");
+        ++failures;
+    }
+    // the writer renders over the oldest frames now, before anything is committed
+    frames = block;
+    writer.acquire(frames);
+    if (!reader.lapped(pos)) {
+        printf("FAIL a reader one ring behind is not lapped while the writer renders over it\n");
+        ++failures;
+    }
+    uint64_t moved = pos;
+    frames = block;
+    reader.peek(moved, frames);
+    if (moved != (uint64_t)block) {
+        printf("FAIL peek returned frames the writer is rendering over\n");
+        ++failures;
+    }
+    writer.commit(block);
+    if (!reader.lapped(pos) || reader.lapped(moved)) {
+        printf("FAIL lapped readers after the commit\n");
+        ++failures;
+    }
+    printf("%d ring checks failed\n", failures);
+    return failures > 0 ? 1 : 0;
+}
+
+// writes parameters of a running synth, given as name value pairs
+int runShmSet(const char *name, int pair_count, char *pairs[])
 {
-public:
-    PureSaw()
-    {
-        volume = 0.8;
-        envelope.attackTime = 0.01f;
-        envelope.decayTime = 0.01f;
-        envelope.startAmplitude = 1.0f;
-        envelope.sustainAmplitude = 0.8f;
-        envelope.releaseTime = 0.01f;
+    ShmControl control;
+    if (!control.open(name)) {
+        printf("Could not open control block %s\n", name);
+        return 1;
     }
-    
-    float sound(float hertz, float t, float timeOn, float timeOff, bool &noteIsAlive)
+    for (int i = 0; i < pair_count; ++i)
     {
-        float amplitude = envelope.getAmplitude(t, timeOn, timeOff);
-        noteIsAlive = amplitude > 0.0f;
-        return volume * amplitude * getWave(WaveType::SAW, t, hertz, 0.001f, 5.0f);
+        const char *param = pairs[2 * i];
+        int id = 0;
+        while (id < (int)ParamId::COUNT && strcmp(Engine::getParamName((ParamId)id), param) != 0) {
+            ++id;
+        }
+        if (id == (int)ParamId::COUNT) {
+            printf("Unknown parameter %s\n", param);
+            return 1;
+        }
+        control.write((ParamId)id, (float)atof(pairs[2 * i + 1]));
     }
-};
+    return 0;
+}
 
-struct Note
+// writes the built in instruments, with their current settings, as a preset bank to start from
+int runBankWrite(const char *path)
 {
-    int id;
-    float freq;
-    float timeOn;
-    float timeOff;
-    bool active;
-    Instrument *instrument;
-    
-    Note()
-    {
-        id = 0;
-        freq = 0.0f;
-        timeOn = 0.0f;
-        timeOff = 0.0f;
-        active = false;
-        instrument = nullptr;
+    Engine engine;
+    const char *names[] = {"bell", "harmonica", "pure_saw"};
+    std::vector<Preset> presets;
+    for (int i = 0; i < (int)InstrumentId::COUNT; ++i) {
+        presets.push_back(makePreset(names[i], (InstrumentId)i, *engine.getInstrument((InstrumentId)i)));
     }
+    if (!PresetBank::write(path, presets.data(), (int)presets.size())) {
+        printf("Could not write %s\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Scope and spectrum of the output, drawn on the UI thread
+// ---------------------------------------------------------------------------
+
+const float SPECTRUM_MIN_HZ = 20.0f;
+const float SPECTRUM_MIN_DB = -90.0f;
+// the level meters on the right: peak, RMS and momentary loudness from -60 dB up
+const int METER_BAR_WIDTH = 12;
+const int METER_BARS = 3;
+const float METER_MIN_DB = -60.0f;
+
+struct ScopeView
+{
+    SDL_Window *screen = nullptr;
+    SDL_Renderer *renderer = nullptr;
+    uint64_t meterBlocks = 0; // the title shows the loudness of this meter block
+    std::vector<float> window; // Hann
+    std::vector<std::complex<float>> spectrum;
+    std::vector<SDL_Point> points;
 };
 
-// custom data structure, passed inside the audio callback
-typedef struct
+bool initScopeView(ScopeView &view, SDL_Window *screen)
 {
-    int sample_nr = 0;
-    std::vector<Note> notes;
-} AudioCustomData;
+    view.screen = screen;
+    view.renderer = SDL_CreateRenderer(screen, -1, SDL_RENDERER_ACCELERATED);
+    view.window.resize(SNAPSHOT_FRAMES);
+    for (int i = 0; i < SNAPSHOT_FRAMES; ++i) {
+        view.window[i] = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / SNAPSHOT_FRAMES);
+    }
+    view.spectrum.resize(SNAPSHOT_FRAMES);
+    return view.renderer != nullptr;
+}
 
+void destroyScopeView(ScopeView &view)
+{
+    if (view.renderer) {
+        SDL_DestroyRenderer(view.renderer);
+    }
+    view.renderer = nullptr;
+}
 
-// audio callback, it is responcible for the audio samples generation
-void audio_callback(void *user_data, Uint8 *raw_buffer, int bytes)
+static void drawMeterBar(ScopeView &view, int index, int width, int height, float db)
 {
-    Sint16 *buffer = (Sint16*)raw_buffer;
-    int length = bytes/2; // 2 bytes per sample for AUDIO_S16SYS
-    AudioCustomData *data = (AudioCustomData *)user_data;
-    
-    // mix all the notes!
-    for (int i = 0; i < length; ++i, data->sample_nr++)
+    float level = std::max(0.0f, std::min(1.0f, 1.0f - db / METER_MIN_DB));
+    int bar_height = (int)(height * level);
+    SDL_Rect bar = {width - (METER_BARS - index) * (METER_BAR_WIDTH + 2), height - bar_height, METER_BAR_WIDTH, bar_height};
+    SDL_RenderFillRect(view.renderer, &bar);
+}
+
+static void drawMeters(ScopeView &view, int width, int height, const MeterReading &meter)
+{
+    SDL_SetRenderDrawColor(view.renderer, meter.peak[0] >= 1.0f ? 240 : 96, 96, 224, 255);
+    drawMeterBar(view, 0, width, height, 20.0f * log10f(meter.peak[0] + 1e-9f));
+    SDL_SetRenderDrawColor(view.renderer, 96, 160, 224, 255);
+    drawMeterBar(view, 1, width, height, 20.0f * log10f(meter.rms[0] + 1e-9f));
+    SDL_SetRenderDrawColor(view.renderer, 224, 224, 96, 255);
+    drawMeterBar(view, 2, width, height, meter.momentary);
+    if (meter.blocks != view.meterBlocks)
     {
-        float time = (float)data->sample_nr / (float)SAMPLE_RATE;
-        buffer[i] = 0;
-        for (Note &note : data->notes)
-        {
-            bool alive;
-            float result = note.instrument->sound(note.freq, time, note.timeOn, note.timeOff, alive);
-            note.active = alive;
-            buffer[i] += (Sint16)(AMPLITUDE/4 * result);
-        }
+        char title[128];
+        snprintf(title, sizeof(title), "Synthetic Soundy - %.1f LUFS momentary, %.1f LUFS short-term",
+                 meter.momentary, meter.shortTerm);
+        SDL_SetWindowTitle(view.screen, title);
+        view.meterBlocks = meter.blocks;
     }
-    // if no notes available, we still are required to provide samples!
-    if (data->notes.empty()) {
-        for (int i = 0; i < length; data->sample_nr++) {
-            buffer[i++] = (Sint16)(0.0f);
-        }
-    }
-    
 }
 
-void initializeKeyMap(std::map<SDL_Scancode, Note> &key_to_note, Instrument *instrument)
+// the waveform in the top half, starting at a rising zero crossing so periodic sounds stand still,
+// the spectrum in dB over a logarithmic frequency axis in the bottom half and the level meters on the right
+void drawScopeView(ScopeView &view, const float *snapshot, const MeterReading &meter)
 {
-    Note note;
-    note.instrument = instrument;
+    if (!view.renderer) {
+        return;
+    }
+    int width = 0, height = 0;
+    SDL_GetRendererOutputSize(view.renderer, &width, &height);
+    SDL_SetRenderDrawColor(view.renderer, 16, 16, 24, 255);
+    SDL_RenderClear(view.renderer);
+    drawMeters(view, width, height, meter);
+    width -= METER_BARS * (METER_BAR_WIDTH + 2) + 4;
+    SDL_SetRenderDrawColor(view.renderer, 48, 48, 64, 255);
+    SDL_RenderDrawLine(view.renderer, 0, height / 4, width, height / 4);
+    SDL_RenderDrawLine(view.renderer, 0, height / 2, width, height / 2);
+    if (!snapshot || width < 2)
+    {
+        SDL_RenderPresent(view.renderer);
+        return;
+    }
     
-    // A3
-    note.id = 0;
-    note.freq = 440.0f * powf(2, -12.f/12);
-    key_to_note[SDL_SCANCODE_Z] = note;
-    // A3#
-    note.id++;
-    note.freq = 440.0f * powf(2, -11.f/12);
-    key_to_note[SDL_SCANCODE_S] = note;
-    // B3
-    note.id++;
-    note.freq = 440.0f * powf(2, -10.f/12);
-    key_to_note[SDL_SCANCODE_X] = note;
-    // C4
-    note.id++;
-    note.freq = 440.0f * powf(2, -9.f/12);
-    key_to_note[SDL_SCANCODE_C] = note;
-    // C4#
-    note.id++;
-    note.freq = 440.0f * powf(2, -8.f/12);
-    key_to_note[SDL_SCANCODE_F] = note;
-    // D4
-    note.id++;
-    note.freq = 440.0f * powf(2, -7.f/12);
-    key_to_note[SDL_SCANCODE_V] = note;
-    // D4#
-    note.id++;
-    note.freq = 440.0f * powf(2, -6.f/12);
-    key_to_note[SDL_SCANCODE_G] = note;
-    // E4
-    note.id++;
-    note.freq = 440.0f * powf(2, -5.f/12);
-    key_to_note[SDL_SCANCODE_B] = note;
-    // E4#
-    note.id++;
-    note.freq = 440.0f * powf(2, -4.f/12);
-    key_to_note[SDL_SCANCODE_N] = note;
-    // F4
-    note.id++;
-    note.freq = 440.0f * powf(2, -3.f/12);
-    key_to_note[SDL_SCANCODE_J] = note;
-    // F4#
-    note.id++;
-    note.freq = 440.0f * powf(2, -2.f/12);
-    key_to_note[SDL_SCANCODE_M] = note;
-    // G4
-    note.id++;
-    note.freq = 440.0f * powf(2, -1.f/12);
-    key_to_note[SDL_SCANCODE_K] = note;
-    // G4#
-    note.id++;
-    note.freq = 440.0f * powf(2, 0.f/12);
-    key_to_note[SDL_SCANCODE_COMMA] = note;
+    // scope
+    const int shown = SNAPSHOT_FRAMES / 2;
+    int start = 0;
+    for (int i = 1; i < SNAPSHOT_FRAMES - shown; ++i) {
+        if (snapshot[i - 1] < 0.0f && snapshot[i] >= 0.0f) {
+            start = i;
+            break;
+        }
+    }
+    view.points.resize(width);
+    for (int x = 0; x < width; ++x)
+    {
+        float sample = std::max(-1.0f, std::min(1.0f, snapshot[start + x * shown / width]));
+        view.points[x] = {x, (int)(height / 4 * (1.0f - sample))};
+    }
+    SDL_SetRenderDrawColor(view.renderer, 96, 224, 128, 255);
+    SDL_RenderDrawLines(view.renderer, view.points.data(), width);
+    
+    // spectrum
+    for (int i = 0; i < SNAPSHOT_FRAMES; ++i) {
+        view.spectrum[i] = std::complex<float>(snapshot[i] * view.window[i], 0.0f);
+    }
+    fft(view.spectrum);
+    const float bin_hz = (float)SAMPLE_RATE / SNAPSHOT_FRAMES;
+    const float octaves = log2f(SAMPLE_RATE / 2 / SPECTRUM_MIN_HZ);
+    // a full scale sine has a magnitude of a quarter of the window length
+    const float full_scale = SNAPSHOT_FRAMES / 4.0f;
+    int bin = 0;
+    for (int x = 0; x < width; ++x)
+    {
+        // the loudest bin up to the frequency of the next pixel, high pixels cover many bins
+        float hertz = SPECTRUM_MIN_HZ * exp2f(octaves * (x + 1) / (width - 1));
+        int last = std::min(SNAPSHOT_FRAMES / 2 - 1, (int)(hertz / bin_hz));
+        float magnitude = std::abs(view.spectrum[std::min(bin, last)]);
+        for (; bin < last; ++bin) {
+            magnitude = std::max(magnitude, std::abs(view.spectrum[bin]));
+        }
+        float db = 20.0f * log10f(magnitude / full_scale + 1e-9f);
+        float level = std::max(0.0f, std::min(1.0f, db / SPECTRUM_MIN_DB));
+        view.points[x] = {x, height / 2 + (int)((height / 2 - 1) * level)};
+    }
+    SDL_SetRenderDrawColor(view.renderer, 224, 160, 64, 255);
+    SDL_RenderDrawLines(view.renderer, view.points.data(), width);
+    SDL_RenderPresent(view.renderer);
 }
 
-
 int main(int argc, char* args[])
 {
+    initRealtimeCheck();
+    if (!initTables()) {
+        fprintf(stderr, "Could not write the table cache, the tables are generated again on every launch\n");
+    }
+    
+    // offline modes, they do not need an audio device
+    if (argc >= 3 && (strcmp(args[1], "--golden-write") == 0 || strcmp(args[1], "--golden-check") == 0))
+    {
+        float max_abs = argc >= 4 ? (float)atof(args[3]) : GOLDEN_MAX_ABS_ERROR;
+        float max_spectral = argc >= 5 ? (float)atof(args[4]) : GOLDEN_MAX_SPECTRAL_DB;
+        return runGolden(args[2], strcmp(args[1], "--golden-write") == 0, max_abs, max_spectral);
+    }
+    if (argc >= 2 && strcmp(args[1], "--stress") == 0)
+    {
+        int buffer_size = argc >= 3 ? atoi(args[2]) : 512;
+        const char *csv_path = argc >= 4 && strcmp(args[3], "-") != 0 ? args[3] : nullptr;
+        int threads = argc >= 5 ? atoi(args[4]) : 1;
+        return runStress(buffer_size > 0 ? buffer_size : 512, csv_path, threads);
+    }
+    if (argc >= 2 && strcmp(args[1], "--scaling") == 0)
+    {
+        int voices = argc >= 3 ? atoi(args[2]) : 256;
+        int buffer_size = argc >= 4 ? atoi(args[3]) : 512;
+        int max_threads = argc >= 5 ? atoi(args[4]) : (int)std::thread::hardware_concurrency();
+        return runScaling(voices > 0 ? voices : 256, buffer_size > 0 ? buffer_size : 512, std::max(1, max_threads));
+    }
+    if (argc >= 5 && strcmp(args[1], "--export") == 0)
+    {
+        int rate = atoi(args[3]);
+        const char *target_lufs = argc >= 6 ? args[5] : nullptr;
+        int threads = argc >= 7 ? atoi(args[6]) : (int)std::thread::hardware_concurrency();
+        float segment_seconds = argc >= 8 ? (float)atof(args[7]) : EXPORT_SEGMENT_SECONDS;
+        return runExport(args[2], rate > 0 ? rate : SAMPLE_RATE, args[4], target_lufs, std::max(1, threads),
+                         segment_seconds > 0 ? segment_seconds : EXPORT_SEGMENT_SECONDS);
+    }
+    if (argc >= 3 && strcmp(args[1], "--export-check") == 0)
+    {
+        float segment_seconds = argc >= 4 ? (float)atof(args[3]) : 0.2f;
+        int threads = argc >= 5 ? atoi(args[4]) : (int)std::thread::hardware_concurrency();
+        return runExportCheck(args[2], segment_seconds > 0 ? segment_seconds : 0.2f, std::max(1, threads));
+    }
+    if (argc >= 2 && strcmp(args[1], "--host") == 0)
+    {
+        int synth_count = argc >= 3 ? atoi(args[2]) : 100;
+        int voices = argc >= 4 ? atoi(args[3]) : 4;
+        int buffer_size = argc >= 5 ? atoi(args[4]) : 512;
+        int threads = argc >= 6 ? atoi(args[5]) : (int)std::thread::hardware_concurrency();
+        return runHost(std::max(1, synth_count), std::max(1, voices), buffer_size > 0 ? buffer_size : 512, std::max(1, threads));
+    }
+    if (argc >= 2 && strcmp(args[1], "--table-bench") == 0)
+    {
+        int voices = argc >= 3 ? atoi(args[2]) : 1000;
+        int tables = argc >= 4 ? atoi(args[3]) : 512;
+        return runTableBench(std::max(1, voices), std::max(1, tables));
+    }
+    if (argc >= 5 && strcmp(args[1], "--shm-record") == 0) {
+        return runShmRecord(args[2], (float)atof(args[3]), args[4]);
+    }
+    if (argc >= 2 && strcmp(args[1], "--limiter-check") == 0) {
+        return runLimiterCheck();
+    }
+    if (argc >= 2 && strcmp(args[1], "--edge-check") == 0) {
+        return runEdgeCheck();
+    }
+    if (argc >= 2 && strcmp(args[1], "--api-check") == 0) {
+        return runApiCheck();
+    }
+    if (argc >= 2 && strcmp(args[1], "--ring-check") == 0) {
+        return runRingCheck();
+    }
+    if (argc >= 5 && strcmp(args[1], "--shm-set") == 0) {
+        return runShmSet(args[2], (argc - 3) / 2, args + 3);
+    }
+    if (argc >= 3 && strcmp(args[1], "--bank-write") == 0) {
+        return runBankWrite(args[2]);
+    }
+    // interactive mode can also share its output and parameters with other processes
+    const char *shm_out = nullptr, *shm_control = nullptr, *bank_path = nullptr, *patch_path = nullptr;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(args[i], "--shm-out") == 0) {
+            shm_out = args[i + 1];
+        }
+        else if (strcmp(args[i], "--shm-control") == 0) {
+            shm_control = args[i + 1];
+        }
+        else if (strcmp(args[i], "--bank") == 0) {
+            bank_path = args[i + 1];
+        }
+        else if (strcmp(args[i], "--patch") == 0) {
+            patch_path = args[i + 1];
+        }
+    }
+    
     if (SDL_Init(SDL_INIT_AUDIO|SDL_INIT_VIDEO|SDL_INIT_EVENTS) == -1)
     {
         printf("Error initializing SDL...\n");
         return 1;
     }
     
+    // every engine object is allocated here, before the audio starts
+    Engine engine((int)std::max(1u, std::thread::hardware_concurrency()));
+    
     // map keyboard to notes
     std::map<SDL_Scancode, Note> key_to_note;
-    Bell bell; Harmonica harmonica;
-    initializeKeyMap(key_to_note, &bell);
+    initializeKeyMap(key_to_note, engine.getInstrument(InstrumentId::BELL));
+    
+    // up and down switch between the patches of the bank
+    PresetBank bank;
+    if (bank_path && !bank.open(bank_path)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to load preset bank %s", bank_path);
+    }
+    PatchSet patches(bank);
+    int patch_index = 0;
+    if (patches.size() > 0 && patches.get(0)) {
+        engine.selectPatch(patches.get(0));
+    }
+    // a patch file is played instead, and reloaded whenever it is saved
+    PatchWatcher watcher;
+    if (patch_path)
+    {
+        watcher.start(patch_path);
+        watcher.update(engine);
+    }
     
+    // a second of audio, readers have that long before they lose samples
+    ShmRing ring;
+    ShmControl control;
+    SnapshotBuffer snapshots;
+    DeviceOutput output = {&engine, nullptr, nullptr, nullptr, &snapshots, nullptr};
+    if (shm_out && ring.create(shm_out, SAMPLE_RATE)) {
+        output.ring = &ring;
+    }
+    else if (shm_out) {
+        SDL_LogError(SDL_LOG_CATEGORY_AUDIO, "Failed to create output ring %s", shm_out);
+    }
+    if (shm_control && control.create(shm_control, engine)) {
+        output.control = &control;
+    }
+    else if (shm_control) {
+        SDL_LogError(SDL_LOG_CATEGORY_AUDIO, "Failed to create control block %s", shm_control);
+    }
     
     // video
     SDL_Window *screen = SDL_CreateWindow("Synthetic Soundy",
@@ -333,25 +1575,39 @@ int main(int argc, char* args[])
                                           SDL_WINDOWPOS_UNDEFINED,
                                           640, 480,
                                           SDL_WINDOW_OPENGL);
+    ScopeView view;
+    if (!initScopeView(view, screen)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to create renderer: %s", SDL_GetError());
+    }
     // audio
-    AudioCustomData custom_data;
-    
     SDL_AudioSpec want;
     want.freq = SAMPLE_RATE;
     want.format = AUDIO_S16SYS;
     want.channels = 1;
     want.samples = 512;
-    want.callback = audio_callback;
-    want.userdata = &custom_data;
+    want.callback = device_audio_callback;
+    want.userdata = &output;
     
+    // the device may run at its own rate, we convert to it rather than letting SDL do it
     SDL_AudioSpec have;
-    SDL_AudioDeviceID audio_device = SDL_OpenAudioDevice(NULL, 0, &want, &have, SDL_AUDIO_ALLOW_FORMAT_CHANGE);
+    SDL_AudioDeviceID audio_device = SDL_OpenAudioDevice(NULL, 0, &want, &have,
+                                                         SDL_AUDIO_ALLOW_FORMAT_CHANGE | SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
     if (audio_device == 0) {
         SDL_LogError(SDL_LOG_CATEGORY_AUDIO, "Failed to open audio: %s", SDL_GetError());
     }
     if (want.format != have.format) {
         SDL_LogError(SDL_LOG_CATEGORY_AUDIO, "Failed to get desired AudioSpec");
     }
+    // the callback does not run before the device is unpaused
+    std::vector<float> scratch;
+    Resampler *resampler = nullptr;
+    if (audio_device != 0 && have.freq != SAMPLE_RATE)
+    {
+        resampler = new Resampler(SAMPLE_RATE, have.freq, have.samples);
+        output.resampler = resampler;
+    }
+    scratch.resize(have.samples * (SAMPLE_RATE / std::max(1, have.freq) + 1) + 2 * RESAMPLER_TAPS);
+    output.scratch = scratch.data();
     
     SDL_PauseAudioDevice(audio_device, 0);
     SDL_Event event;
@@ -359,9 +1615,11 @@ int main(int argc, char* args[])
     while(!quit)
     {
         SDL_LockAudioDevice(audio_device);
+        if (patch_path) {
+            watcher.update(engine);
+        }
         while(SDL_PollEvent(&event))
         {
-            float sound_time = (float)custom_data.sample_nr / (float)SAMPLE_RATE;
             if (event.type == SDL_QUIT) {
                 quit = true;
             }
@@ -371,12 +1629,18 @@ int main(int argc, char* args[])
                 // check if such key is mapped to a note
                 SDL_Scancode scancode = event.key.keysym.scancode;
                 auto it = key_to_note.find(scancode);
-                // if yes, push it in the vector
+                // if yes, start playing it
                 if (it != key_to_note.end()) {
-                    Note note = it->second;
-                    note.timeOn = sound_time;
-                    note.active = true;
-                    custom_data.notes.push_back(note);
+                    engine.noteOn(it->second.id, it->second.freq);
+                }
+                else if ((scancode == SDL_SCANCODE_UP || scancode == SDL_SCANCODE_DOWN) && patches.size() > 0)
+                {
+                    int step = scancode == SDL_SCANCODE_UP ? 1 : patches.size() - 1;
+                    patch_index = (patch_index + step) % patches.size();
+                    if (patches.get(patch_index)) {
+                        engine.selectPatch(patches.get(patch_index));
+                    }
+                    printf("Patch %d: %s\n", patch_index, bank.get(patch_index).name);
                 }
             }
             // key was released
@@ -384,26 +1648,21 @@ int main(int argc, char* args[])
                 SDL_Scancode scancode = event.key.keysym.scancode;
                 auto it = key_to_note.find(scancode);
                 if (it != key_to_note.end()) {
-                    int note_id = it->second.id;
-                    for (Note &n : custom_data.notes) {
-                        if (n.id == note_id) {
-                            n.timeOff = sound_time;
-                        }
-                    }
+                    engine.noteOff(it->second.id);
                 }
             }
         }
-        // remove non-active notes from vector
-        custom_data.notes.erase(std::remove_if(custom_data.notes.begin(), custom_data.notes.end(),
-                                               [](const Note& n){ return !n.active;}),
-                                custom_data.notes.end());
         SDL_UnlockAudioDevice(audio_device);
         
+        // all the analysis happens here, the audio thread only copied the samples
+        drawScopeView(view, snapshots.read(), engine.readMeter());
         SDL_Delay(1000/30);
     }
 
+    destroyScopeView(view);
     SDL_DestroyWindow(screen);
     SDL_CloseAudioDevice(audio_device);
+    DELETE_PTR(resampler);
     SDL_Quit();
 
     return 0;
@@ -0,0 +1,390 @@
+// CLAP instrument plugin wrapping the engine. Host blocks are rendered straight into the host's output buffer,
+// split at every incoming event so notes start and stop on their exact frame.
+
+#include <algorithm>
+#include <atomic>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <clap/clap.h>
+
+#include "../engine/synth.h"
+
+const clap_id INSTRUMENT_PARAM_ID = 0;
+const char *INSTRUMENT_NAMES[] = {"Bell", "Harmonica", "Pure saw"};
+const int INSTRUMENT_COUNT = 3;
+
+static const char *features[] = {
+    CLAP_PLUGIN_FEATURE_INSTRUMENT, CLAP_PLUGIN_FEATURE_SYNTHESIZER, CLAP_PLUGIN_FEATURE_MONO, nullptr
+};
+
+static const clap_plugin_descriptor_t descriptor = {
+    .clap_version = CLAP_VERSION_INIT,
+    .id = "com.plukraine.synthy",
+    .name = "Synthy",
+    .vendor = "PLUkraine",
+    .url = "https://github.com/PLUkraine/Synthy-Sound",
+    .manual_url = "",
+    .support_url = "",
+    .version = "0.1.0",
+    .description = "Bell, harmonica and saw instruments of Synthy Sound",
+    .features = features,
+};
+
+struct SynthyPlugin
+{
+    clap_plugin_t plugin;
+    const clap_host_t *host;
+    synth *s;
+    std::atomic<int> instrument;
+};
+
+static SynthyPlugin *self(const clap_plugin_t *plugin)
+{
+    return (SynthyPlugin*)plugin->plugin_data;
+}
+
+// one engine note per key and channel, so the same key on two channels plays two notes
+static int noteId(const clap_event_note_t *note)
+{
+    return std::max<int>(0, note->channel) * 128 + note->key;
+}
+
+static float keyToHertz(int key)
+{
+    return 440.0f * powf(2.0f, (key - 69) / 12.0f);
+}
+
+static void handleEvent(SynthyPlugin *p, const clap_event_header_t *header)
+{
+    if (header->space_id != CLAP_CORE_EVENT_SPACE_ID) {
+        return;
+    }
+    switch (header->type) {
+        case CLAP_EVENT_NOTE_ON: {
+            const clap_event_note_t *note = (const clap_event_note_t*)header;
+            if (p->s && note->key >= 0) {
+                synth_note_on(p->s, noteId(note), keyToHertz(note->key), p->instrument.load(std::memory_order_relaxed));
+            }
+            break;
+        }
+        case CLAP_EVENT_NOTE_OFF:
+        case CLAP_EVENT_NOTE_CHOKE: {
+            const clap_event_note_t *note = (const clap_event_note_t*)header;
+            if (p->s && note->key >= 0) {
+                synth_note_off(p->s, noteId(note));
+            }
+            break;
+        }
+        case CLAP_EVENT_MIDI: {
+            const clap_event_midi_t *midi = (const clap_event_midi_t*)header;
+            int status = midi->data[0] & 0xf0, channel = midi->data[0] & 0x0f;
+            int key = midi->data[1], velocity = midi->data[2];
+            if (!p->s) {
+                break;
+            }
+            if (status == 0x90 && velocity > 0) {
+                synth_note_on(p->s, channel * 128 + key, keyToHertz(key), p->instrument.load(std::memory_order_relaxed));
+            }
+            else if (status == 0x80 || status == 0x90) {
+                synth_note_off(p->s, channel * 128 + key);
+            }
+            break;
+        }
+        case CLAP_EVENT_PARAM_VALUE: {
+            const clap_event_param_value_t *param = (const clap_event_param_value_t*)header;
+            if (param->param_id == INSTRUMENT_PARAM_ID) {
+                // affects the notes started from now on
+                p->instrument.store(std::clamp((int)lround(param->value), 0, INSTRUMENT_COUNT - 1));
+            }
+            break;
+        }
+    }
+}
+
+static bool pluginInit(const clap_plugin_t *)
+{
+    return true;
+}
+
+static void pluginDestroy(const clap_plugin_t *plugin)
+{
+    SynthyPlugin *p = self(plugin);
+    if (p->s) {
+        synth_destroy(p->s);
+    }
+    delete p;
+}
+
+static bool pluginActivate(const clap_plugin_t *plugin, double sample_rate, uint32_t, uint32_t)
+{
+    // the engine renders at a fixed rate, other rates would play out of tune
+    if (sample_rate != SYNTH_SAMPLE_RATE) {
+        fprintf(stderr, "Synthy: unsupported sample rate %.0f, only %d Hz works\n", sample_rate, SYNTH_SAMPLE_RATE);
+        return false;
+    }
+    SynthyPlugin *p = self(plugin);
+    // the host owns the threads, render on the one calling process()
+    p->s = synth_create(1, 0);
+    return p->s != nullptr;
+}
+
+static void pluginDeactivate(const clap_plugin_t *plugin)
+{
+    SynthyPlugin *p = self(plugin);
+    synth_destroy(p->s);
+    p->s = nullptr;
+}
+
+static bool pluginStartProcessing(const clap_plugin_t *)
+{
+    return true;
+}
+
+static void pluginStopProcessing(const clap_plugin_t *)
+{
+}
+
+static void pluginReset(const clap_plugin_t *)
+{
+    // sounding notes end through their own release, there is no other state to clear
+}
+
+static clap_process_status pluginProcess(const clap_plugin_t *plugin, const clap_process_t *process)
+{
+    SynthyPlugin *p = self(plugin);
+    if (process->audio_outputs_count == 0 || process->audio_outputs[0].channel_count == 0) {
+        return CLAP_PROCESS_ERROR;
+    }
+    float *out = process->audio_outputs[0].data32[0];
+    const uint32_t frames = process->frames_count;
+    const clap_input_events_t *in = process->in_events;
+    const uint32_t event_count = in->size(in);
+    
+    uint32_t done = 0;
+    for (uint32_t i = 0; i < event_count; ++i)
+    {
+        const clap_event_header_t *header = in->get(in, i);
+        uint32_t time = std::min(header->time, frames);
+        // events on adjacent frames give one frame renders, the engine keeps notes in their attack alive through them
+        // (see --api-check)
+        if (time > done) {
+            synth_render(p->s, out + done, time - done);
+            done = time;
+        }
+        handleEvent(p, header);
+    }
+    if (done < frames) {
+        synth_render(p->s, out + done, frames - done);
+    }
+    process->audio_outputs[0].constant_mask = 0;
+    return synth_active_notes(p->s) > 0 ? CLAP_PROCESS_CONTINUE : CLAP_PROCESS_SLEEP;
+}
+
+// audio ports: one mono output
+static uint32_t audioPortsCount(const clap_plugin_t *, bool is_input)
+{
+    return is_input ? 0 : 1;
+}
+
+static bool audioPortsGet(const clap_plugin_t *, uint32_t index, bool is_input, clap_audio_port_info_t *info)
+{
+    if (is_input || index != 0) {
+        return false;
+    }
+    info->id = 0;
+    snprintf(info->name, sizeof(info->name), "%s", "Output");
+    info->flags = CLAP_AUDIO_PORT_IS_MAIN;
+    info->channel_count = 1;
+    info->port_type = CLAP_PORT_MONO;
+    info->in_place_pair = CLAP_INVALID_ID;
+    return true;
+}
+
+static const clap_plugin_audio_ports_t audio_ports = {
+    .count = audioPortsCount,
+    .get = audioPortsGet,
+};
+
+// note ports: one input, CLAP notes or MIDI
+static uint32_t notePortsCount(const clap_plugin_t *, bool is_input)
+{
+    return is_input ? 1 : 0;
+}
+
+static bool notePortsGet(const clap_plugin_t *, uint32_t index, bool is_input, clap_note_port_info_t *info)
+{
+    if (!is_input || index != 0) {
+        return false;
+    }
+    info->id = 0;
+    info->supported_dialects = CLAP_NOTE_DIALECT_CLAP | CLAP_NOTE_DIALECT_MIDI;
+    info->preferred_dialect = CLAP_NOTE_DIALECT_CLAP;
+    snprintf(info->name, sizeof(info->name), "%s", "Notes");
+    return true;
+}
+
+static const clap_plugin_note_ports_t note_ports = {
+    .count = notePortsCount,
+    .get = notePortsGet,
+};
+
+// params: the instrument used by new notes
+static uint32_t paramsCount(const clap_plugin_t *)
+{
+    return 1;
+}
+
+static bool paramsGetInfo(const clap_plugin_t *, uint32_t index, clap_param_info_t *info)
+{
+    if (index != 0) {
+        return false;
+    }
+    memset(info, 0, sizeof(*info));
+    info->id = INSTRUMENT_PARAM_ID;
+    info->flags = CLAP_PARAM_IS_STEPPED | CLAP_PARAM_IS_AUTOMATABLE;
+    snprintf(info->name, sizeof(info->name), "%s", "Instrument");
+    info->min_value = 0;
+    info->max_value = INSTRUMENT_COUNT - 1;
+    info->default_value = SYNTH_INSTRUMENT_BELL;
+    return true;
+}
+
+static bool paramsGetValue(const clap_plugin_t *plugin, clap_id id, double *value)
+{
+    if (id != INSTRUMENT_PARAM_ID) {
+        return false;
+    }
+    *value = self(plugin)->instrument.load();
+    return true;
+}
+
+static bool paramsValueToText(const clap_plugin_t *, clap_id id, double value, char *display, uint32_t size)
+{
+    int index = (int)lround(value);
+    if (id != INSTRUMENT_PARAM_ID || index < 0 || index >= INSTRUMENT_COUNT) {
+        return false;
+    }
+    snprintf(display, size, "%s", INSTRUMENT_NAMES[index]);
+    return true;
+}
+
+static bool paramsTextToValue(const clap_plugin_t *, clap_id id, const char *display, double *value)
+{
+    if (id != INSTRUMENT_PARAM_ID) {
+        return false;
+    }
+    for (int i = 0; i < INSTRUMENT_COUNT; ++i) {
+        if (strcmp(display, INSTRUMENT_NAMES[i]) == 0) {
+            *value = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void paramsFlush(const clap_plugin_t *plugin, const clap_input_events_t *in, const clap_output_events_t *)
+{
+    for (uint32_t i = 0; i < in->size(in); ++i) {
+        const clap_event_header_t *header = in->get(in, i);
+        if (header->space_id == CLAP_CORE_EVENT_SPACE_ID && header->type == CLAP_EVENT_PARAM_VALUE) {
+            handleEvent(self(plugin), header);
+        }
+    }
+}
+
+static const clap_plugin_params_t params = {
+    .count = paramsCount,
+    .get_info = paramsGetInfo,
+    .get_value = paramsGetValue,
+    .value_to_text = paramsValueToText,
+    .text_to_value = paramsTextToValue,
+    .flush = paramsFlush,
+};
+
+static const void *pluginGetExtension(const clap_plugin_t *, const char *id)
+{
+    if (strcmp(id, CLAP_EXT_AUDIO_PORTS) == 0) {
+        return &audio_ports;
+    }
+    if (strcmp(id, CLAP_EXT_NOTE_PORTS) == 0) {
+        return &note_ports;
+    }
+    if (strcmp(id, CLAP_EXT_PARAMS) == 0) {
+        return &params;
+    }
+    return nullptr;
+}
+
+static void pluginOnMainThread(const clap_plugin_t *)
+{
+}
+
+static const clap_plugin_t *createPlugin(const clap_host_t *host)
+{
+    SynthyPlugin *p = new SynthyPlugin();
+    p->host = host;
+    p->s = nullptr;
+    p->instrument.store(SYNTH_INSTRUMENT_BELL);
+    p->plugin.desc = &descriptor;
+    p->plugin.plugin_data = p;
+    p->plugin.init = pluginInit;
+    p->plugin.destroy = pluginDestroy;
+    p->plugin.activate = pluginActivate;
+    p->plugin.deactivate = pluginDeactivate;
+    p->plugin.start_processing = pluginStartProcessing;
+    p->plugin.stop_processing = pluginStopProcessing;
+    p->plugin.reset = pluginReset;
+    p->plugin.process = pluginProcess;
+    p->plugin.get_extension = pluginGetExtension;
+    p->plugin.on_main_thread = pluginOnMainThread;
+    return &p->plugin;
+}
+
+static uint32_t factoryGetPluginCount(const clap_plugin_factory_t *)
+{
+    return 1;
+}
+
+static const clap_plugin_descriptor_t *factoryGetPluginDescriptor(const clap_plugin_factory_t *, uint32_t index)
+{
+    return index == 0 ? &descriptor : nullptr;
+}
+
+static const clap_plugin_t *factoryCreatePlugin(const clap_plugin_factory_t *, const clap_host_t *host, const char *plugin_id)
+{
+    if (!clap_version_is_compatible(host->clap_version) || strcmp(plugin_id, descriptor.id) != 0) {
+        return nullptr;
+    }
+    return createPlugin(host);
+}
+
+static const clap_plugin_factory_t factory = {
+    .get_plugin_count = factoryGetPluginCount,
+    .get_plugin_descriptor = factoryGetPluginDescriptor,
+    .create_plugin = factoryCreatePlugin,
+};
+
+static bool entryInit(const char *)
+{
+    return true;
+}
+
+static void entryDeinit()
+{
+}
+
+static const void *entryGetFactory(const char *factory_id)
+{
+    return strcmp(factory_id, CLAP_PLUGIN_FACTORY_ID) == 0 ? &factory : nullptr;
+}
+
+extern "C" CLAP_EXPORT const clap_plugin_entry_t clap_entry = {
+    .clap_version = CLAP_VERSION_INIT,
+    .init = entryInit,
+    .deinit = entryDeinit,
+    .get_factory = entryGetFactory,
+};
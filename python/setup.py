@@ -0,0 +1,22 @@
+# builds the synthy extension module: pip install ./python (or python setup.py build_ext --inplace)
+import glob
+import os
+
+from setuptools import Extension, setup
+
+here = os.path.dirname(os.path.abspath(__file__))
+engine_sources = sorted(glob.glob(os.path.join(here, "..", "engine", "*.cpp")))
+
+setup(
+    name="synthy",
+    version="0.1",
+    ext_modules=[
+        Extension(
+            "synthy",
+            sources=[os.path.join(here, "synthy_module.cpp")] + engine_sources,
+            extra_compile_args=["-std=c++20", "-O2"],
+            extra_link_args=["-pthread"],
+            language="c++",
+        )
+    ],
+)
@@ -0,0 +1,254 @@
+// Python bindings of the engine C API. Rendering writes straight into caller provided buffers
+// (NumPy arrays, array.array, ...) through the buffer protocol and runs without the GIL.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <atomic>
+
+#include <string.h>
+
+#include "../engine/synth.h"
+
+typedef struct
+{
+    PyObject_HEAD
+    synth *s;
+    // set while the GIL is released, a second thread must not use the same synth meanwhile
+    std::atomic<bool> busy;
+} SynthObject;
+
+// takes busy, raises RuntimeError when another thread is rendering with the synth
+static bool take(SynthObject *self)
+{
+    bool expected = false;
+    if (!self->busy.compare_exchange_strong(expected, true)) {
+        PyErr_SetString(PyExc_RuntimeError, "Synth is used by another thread");
+        return false;
+    }
+    return true;
+}
+
+static void release(SynthObject *self)
+{
+    self->busy.store(false);
+}
+
+// claims the synth for a call, also raises when there is none (Synth.__new__() without __init__(), or a failed one)
+static bool claim(SynthObject *self)
+{
+    if (!take(self)) {
+        return false;
+    }
+    if (!self->s) {
+        release(self);
+        PyErr_SetString(PyExc_RuntimeError, "Synth is not initialized");
+        return false;
+    }
+    return true;
+}
+
+static int Synth_init(SynthObject *self, PyObject *args, PyObject *kwargs)
+{
+    static const char *keywords[] = {"render_threads", "max_notes", nullptr};
+    int render_threads = 1, max_notes = 256;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|ii", (char**)keywords, &render_threads, &max_notes)) {
+        return -1;
+    }
+    // __init__() may be called again, not while another thread renders with the old synth
+    if (!take(self)) {
+        return -1;
+    }
+    if (self->s) {
+        synth_destroy(self->s);
+    }
+    self->s = synth_create(render_threads, max_notes);
+    release(self);
+    if (!self->s) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    return 0;
+}
+
+static void Synth_dealloc(SynthObject *self)
+{
+    if (self->s) {
+        synth_destroy(self->s);
+    }
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyObject *Synth_note_on(SynthObject *self, PyObject *args, PyObject *kwargs)
+{
+    static const char *keywords[] = {"note_id", "hertz", "instrument", nullptr};
+    int note_id, instrument = SYNTH_INSTRUMENT_BELL;
+    float hertz;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "if|i", (char**)keywords, &note_id, &hertz, &instrument) || !claim(self)) {
+        return nullptr;
+    }
+    int result = synth_note_on(self->s, note_id, hertz, instrument);
+    release(self);
+    return PyBool_FromLong(result == 0);
+}
+
+static PyObject *Synth_note_off(SynthObject *self, PyObject *args)
+{
+    int note_id;
+    if (!PyArg_ParseTuple(args, "i", &note_id) || !claim(self)) {
+        return nullptr;
+    }
+    synth_note_off(self->s, note_id);
+    release(self);
+    Py_RETURN_NONE;
+}
+
+static PyObject *Synth_seed_noise(SynthObject *self, PyObject *args)
+{
+    unsigned int seed;
+    if (!PyArg_ParseTuple(args, "I", &seed) || !claim(self)) {
+        return nullptr;
+    }
+    synth_seed_noise(self->s, seed);
+    release(self);
+    Py_RETURN_NONE;
+}
+
+static PyObject *Synth_active_notes(SynthObject *self, PyObject *)
+{
+    if (!claim(self)) {
+        return nullptr;
+    }
+    int active = synth_active_notes(self->s);
+    release(self);
+    return PyLong_FromLong(active);
+}
+
+// gets a writable, C contiguous float32 view of any shape, rendered as one flat block
+static bool getOutput(PyObject *object, Py_buffer *view)
+{
+    if (PyObject_GetBuffer(object, view, PyBUF_WRITABLE | PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) != 0) {
+        return false;
+    }
+    const char *format = view->format ? view->format : "B";
+    if (format[0] == '<' || format[0] == '=' || format[0] == '@') {
+        format++;
+    }
+    if (view->itemsize != sizeof(float) || strcmp(format, "f") != 0) {
+        PyBuffer_Release(view);
+        PyErr_SetString(PyExc_TypeError, "output buffer must be float32");
+        return false;
+    }
+    if (view->len / (Py_ssize_t)sizeof(float) > INT32_MAX) {
+        PyBuffer_Release(view);
+        PyErr_SetString(PyExc_ValueError, "output buffer is too large for one render call");
+        return false;
+    }
+    return true;
+}
+
+static PyObject *Synth_render(SynthObject *self, PyObject *args)
+{
+    PyObject *out_object;
+    Py_buffer out;
+    if (!PyArg_ParseTuple(args, "O", &out_object) || !getOutput(out_object, &out)) {
+        return nullptr;
+    }
+    if (!claim(self)) {
+        PyBuffer_Release(&out);
+        return nullptr;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    synth_render(self->s, (float*)out.buf, (int)(out.len / sizeof(float)));
+    Py_END_ALLOW_THREADS
+    release(self);
+    PyBuffer_Release(&out);
+    Py_RETURN_NONE;
+}
+
+static PyObject *Synth_render_events(SynthObject *self, PyObject *args)
+{
+    PyObject *out_object, *events_object;
+    Py_buffer out, events;
+    if (!PyArg_ParseTuple(args, "OO", &out_object, &events_object) || !getOutput(out_object, &out)) {
+        return nullptr;
+    }
+    if (PyObject_GetBuffer(events_object, &events, PyBUF_RECORDS_RO) != 0) {
+        PyBuffer_Release(&out);
+        return nullptr;
+    }
+    if (events.itemsize != sizeof(synth_event) || !PyBuffer_IsContiguous(&events, 'C')) {
+        PyBuffer_Release(&events);
+        PyBuffer_Release(&out);
+        PyErr_SetString(PyExc_TypeError, "events must be a contiguous array of synthy.EVENT_DTYPE records");
+        return nullptr;
+    }
+    if (!claim(self)) {
+        PyBuffer_Release(&events);
+        PyBuffer_Release(&out);
+        return nullptr;
+    }
+    int dropped;
+    Py_BEGIN_ALLOW_THREADS
+    dropped = synth_render_events(self->s, (float*)out.buf, (int)(out.len / sizeof(float)),
+                                  (const synth_event*)events.buf, (int)(events.len / sizeof(synth_event)));
+    Py_END_ALLOW_THREADS
+    release(self);
+    PyBuffer_Release(&events);
+    PyBuffer_Release(&out);
+    return PyLong_FromLong(dropped);
+}
+
+static PyMethodDef Synth_methods[] = {
+    {"note_on", (PyCFunction)(void(*)(void))Synth_note_on, METH_VARARGS | METH_KEYWORDS,
+     "note_on(note_id, hertz, instrument=BELL) -> bool, False when the note was dropped"},
+    {"note_off", (PyCFunction)Synth_note_off, METH_VARARGS, "note_off(note_id), releases every note with that id"},
+    {"seed_noise", (PyCFunction)Synth_seed_noise, METH_VARARGS, "seed_noise(seed), for reproducible renders"},
+    {"active_notes", (PyCFunction)Synth_active_notes, METH_NOARGS, "number of notes still sounding"},
+    {"render", (PyCFunction)Synth_render, METH_VARARGS,
+     "render(out), fills a writable float32 buffer in place without holding the GIL"},
+    {"render_events", (PyCFunction)Synth_render_events, METH_VARARGS,
+     "render_events(out, events) -> dropped note ons; events is an EVENT_DTYPE array sorted by frame"},
+    {nullptr, nullptr, 0, nullptr}
+};
+
+static PyTypeObject SynthType = {
+    PyVarObject_HEAD_INIT(nullptr, 0)
+};
+
+static PyModuleDef synthy_module = {
+    PyModuleDef_HEAD_INIT, "synthy", "Synthy engine bindings, mono output at SAMPLE_RATE", -1,
+};
+
+PyMODINIT_FUNC PyInit_synthy(void)
+{
+    SynthType.tp_name = "synthy.Synth";
+    SynthType.tp_doc = "Synth(render_threads=1, max_notes=256)";
+    SynthType.tp_basicsize = sizeof(SynthObject);
+    SynthType.tp_flags = Py_TPFLAGS_DEFAULT;
+    SynthType.tp_new = PyType_GenericNew;
+    SynthType.tp_init = (initproc)Synth_init;
+    SynthType.tp_dealloc = (destructor)Synth_dealloc;
+    SynthType.tp_methods = Synth_methods;
+    if (PyType_Ready(&SynthType) < 0) {
+        return nullptr;
+    }
+    
+    PyObject *module = PyModule_Create(&synthy_module);
+    if (!module) {
+        return nullptr;
+    }
+    Py_INCREF(&SynthType);
+    PyModule_AddObject(module, "Synth", (PyObject*)&SynthType);
+    PyModule_AddIntConstant(module, "SAMPLE_RATE", SYNTH_SAMPLE_RATE);
+    PyModule_AddIntConstant(module, "BELL", SYNTH_INSTRUMENT_BELL);
+    PyModule_AddIntConstant(module, "HARMONICA", SYNTH_INSTRUMENT_HARMONICA);
+    PyModule_AddIntConstant(module, "PURE_SAW", SYNTH_INSTRUMENT_PURE_SAW);
+    PyModule_AddIntConstant(module, "NOTE_ON", SYNTH_EVENT_NOTE_ON);
+    PyModule_AddIntConstant(module, "NOTE_OFF", SYNTH_EVENT_NOTE_OFF);
+    // numpy.dtype(synthy.EVENT_DTYPE) matches synth_event
+    PyModule_AddObject(module, "EVENT_DTYPE", Py_BuildValue("[(ss)(ss)(ss)(ss)(ss)]",
+                                                            "frame", "<i4", "type", "<i4", "note_id", "<i4",
+                                                            "instrument", "<i4", "hertz", "<f4"));
+    return module;
+}